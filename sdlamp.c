@@ -1,6 +1,5 @@
 /* fixes
 - inconsistencies using skin global vs passing a pointer to it in functions
-- lots of code duplication in handling events, hit testing, and drawing (search for if (winshade_mode))
 
 */
 
@@ -10,6 +9,13 @@
 #include "physfs.h"
 #include "physfsrwops.h"
 
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 typedef void (*ClickFn)(void);
 
 // tagging struct so that it doesn't show up as unnamed in VSCode
@@ -52,6 +58,81 @@ typedef struct WinampSkinSlider {
 // tagging enum so that it doesn't show up as unnamed in VSCode
 typedef enum WinampSkinSliderID { SLD_VOLUME, SLD_BALANCE, SLD_TOTAL } WinampSkinSliderID;
 
+// tagging enum so that it doesn't show up as unnamed in VSCode
+typedef enum WinampSkinTexID { TEX_MAIN, TEX_CBUTTONS, TEX_VOLUME, TEX_BALANCE, TEX_TITLEBAR } WinampSkinTexID;
+
+// tagging enum so that it doesn't show up as unnamed in VSCode
+typedef enum WinampSkinMode { MODE_NORMAL, MODE_WINSHADE, MODE_TOTAL } WinampSkinMode;
+
+#define SKIN_W 275
+#define SKIN_H 116
+#define SKIN_WINSHADE_H 14
+
+// layouts are plain tables, load_skin turns them into buttons/sliders and a hit grid
+// tagging struct so that it doesn't show up as unnamed in VSCode
+typedef struct WinampSkinBtnLayout {
+    WinampSkinTexID tex;
+    ClickFn clickfn;
+    SDL_Rect src_unpressed_rect;
+    SDL_Rect src_pressed_rect;
+    SDL_Rect dest_rect;
+} WinampSkinBtnLayout;
+
+// tagging struct so that it doesn't show up as unnamed in VSCode
+typedef struct WinampSkinSliderLayout {
+    WinampSkinTexID tex;
+    SDL_Rect knob_src_unpressed_rect;
+    SDL_Rect knob_src_pressed_rect;
+    int frame_x_offset;
+    int frame_y_offset;
+    int n_frames;
+    int frame_width;
+    int frame_height;
+    SDL_Rect dest_rect;
+    float val;
+} WinampSkinSliderLayout;
+
+// tagging struct so that it doesn't show up as unnamed in VSCode
+typedef struct WinampSkinLayout {
+    const WinampSkinBtnLayout* buttons;  // indexed by WinampSkinBtnID
+    int n_buttons;
+    const WinampSkinSliderLayout* sliders;
+    int n_sliders;
+    int h;
+} WinampSkinLayout;
+
+// widget ids are what the hit grid stores: 0 is nothing, then every button, then every slider of the mode
+#define WIDGET_NONE 0
+#define WIDGET_MAX (1 + BTN_TOTAL + SLD_TOTAL)
+
+// polygons from one region.txt section, NumPoints says how many of the PointList points go to each polygon
+#define REGION_MAX_POLYS 32
+#define REGION_MAX_POINTS 256
+// tagging struct so that it doesn't show up as unnamed in VSCode
+typedef struct WinampSkinRegion {
+    int n_polys;
+    int n_points[REGION_MAX_POLYS];
+    int n_coords;
+    int coords[REGION_MAX_POINTS * 2];  // x,y pairs
+} WinampSkinRegion;
+
+// everything that changes how a widget gets drawn, compared against what's in the canvas to find dirty widgets
+// tagging struct so that it doesn't show up as unnamed in VSCode
+typedef struct WinampSkinWidgetLook {
+    SDL_bool pressed;
+    float val;
+    int knob_x;
+    int knob_src_x;
+} WinampSkinWidgetLook;
+
+// btn is what gets pressed (a button, or a slider's knob), slider is set for sliders only
+// tagging struct so that it doesn't show up as unnamed in VSCode
+typedef struct WinampSkinWidget {
+    WinampSkinBtn* btn;
+    WinampSkinSlider* slider;
+    WinampSkinWidgetLook drawn;
+} WinampSkinWidget;
+
 // tagging struct so that it doesn't show up as unnamed in VSCode
 typedef struct WinampSkin {
     SDL_Texture* tex_main;
@@ -64,24 +145,258 @@ typedef struct WinampSkin {
     WinampSkinSlider sliders[SLD_TOTAL];
     WinampSkinSlider winshade_slider;
     WinampSkinBtn* pressed_btn;
+    Uint8 pressed_widget;
+
+    WinampSkinWidget widgets[MODE_TOTAL][WIDGET_MAX];
+    Uint8 hit_grid[MODE_TOTAL][SKIN_W * SKIN_H];  // one widget id per pixel, rows are SKIN_W wide
+
+    SDL_Surface* shape[MODE_TOTAL];  // window shape masks from region.txt, alpha 0 is cut out
+
+    // what's currently composited into the canvas. canvas_valid SDL_FALSE forces a full redraw
+    SDL_bool canvas_valid;
+    WinampSkinMode drawn_mode;
+    int drawn_tbar_y;
 
 } WinampSkin;
 
-static SDL_AudioDeviceID audio_device = 0;
+// SDLAMP_RECORD=file writes every event handle_events consumes, with a timestamp. SDLAMP_REPLAY=file feeds them back
+// on a fixed clock instead of polling, so the same run can be timed over and over (on headless machines too)
+#define INPUT_TAPE_MAGIC "SDLAMPEV"
+#define INPUT_TAPE_VERSION 1
+// tagging struct so that it doesn't show up as unnamed in VSCode
+typedef struct InputTape {
+    SDL_RWops* record;
+    Uint32 record_start_ticks;
+
+    SDL_RWops* replay;
+    Uint32 replay_clock;    // ms, advances by replay_step_ms every frame no matter how long frames really take
+    Uint32 replay_step_ms;
+    SDL_bool have_pending;  // next event was read already but isn't due yet
+    Uint32 pending_ms;
+    SDL_Event pending;
+    SDL_bool replay_done;
+} InputTape;
+
+// per frame perf counter ticks, only collected while replaying. recordings run interactively with vsync on, so their
+// draw_frame times would mostly be the wait for vblank
+// tagging struct so that it doesn't show up as unnamed in VSCode
+typedef struct FrameTiming {
+    Uint64 events_ticks;
+    Uint64 draw_ticks;
+} FrameTiming;
+
+// a DSP stage processes interleaved F32 stereo in place. process functions run on the audio thread so they must not
+// allocate, lock, or block
+typedef struct DspStage DspStage;
+typedef void (*DspProcessFn)(DspStage* stage, float* interleaved, int n_frames);
+typedef void (*DspResetFn)(DspStage* stage);
+
+// tagging struct so that it doesn't show up as unnamed in VSCode
+typedef struct DspStage {
+    const char* name;
+    DspProcessFn process;
+    DspResetFn reset;  // optional, called when the stage comes out of bypass so it doesn't resume on stale state
+    void* userdata;
+    SDL_atomic_t bypass;  // written by the UI thread, read by the audio thread
+    SDL_atomic_t last_usecs;  // time spent in the last process call
+    SDL_atomic_t peak_usecs;  // worst process call since the stage was created
+    SDL_bool was_bypassed;  // audio thread only
+} DspStage;
+
+#define DSP_MAX_STAGES 16
+
+// a chain is an immutable, ordered list of stages. the UI thread builds a new one and publishes it, the audio thread
+// swaps it in at the start of a block and hands the old one back to be freed on the UI thread
+// tagging struct so that it doesn't show up as unnamed in VSCode
+typedef struct DspChain {
+    int n_stages;
+    DspStage* stages[DSP_MAX_STAGES];
+} DspChain;
+
+// active belongs to the audio thread. pending and retired are the two hand-off slots between the UI thread and the
+// audio thread, both only ever swapped atomically
+// tagging struct so that it doesn't show up as unnamed in VSCode
+typedef struct DspChainSlot {
+    DspChain* active;
+    void* pending;
+    void* retired;
+} DspChainSlot;
+
+// ramp state for the gain stages, only ever touched from the audio thread. target is the UI-published parameter
+// tagging struct so that it doesn't show up as unnamed in VSCode
+typedef struct DspGainState {
+    SDL_atomic_t* target;
+    float cur_l;
+    float cur_r;
+} DspGainState;
+
+// lookahead true-peak limiter. the audio is delayed by LIMITER_LOOKAHEAD_FRAMES + 1 so the gain can already be
+// ramped down by the time a peak comes out. true peaks are estimated by catmull-rom interpolating 3 points between
+// every pair of samples, which catches most inter-sample overs a DAC would otherwise clip on
+#define LIMITER_LOOKAHEAD_FRAMES 64
+#define LIMITER_DELAY_FRAMES (LIMITER_LOOKAHEAD_FRAMES + 1)
+#define LIMITER_WINDOW_FRAMES (LIMITER_LOOKAHEAD_FRAMES + 2)
+#define LIMITER_DEQUE_SIZE 128  // power of two >= LIMITER_WINDOW_FRAMES
+#define LIMITER_CHUNK_FRAMES 1024
+
+// tagging struct so that it doesn't show up as unnamed in VSCode
+typedef struct DspLimiterState {
+    float ceiling;
+    float release_coeff;
+    // delayed audio from the last chunk followed by the current chunk, interleaved stereo
+    float buf[(LIMITER_DELAY_FRAMES + LIMITER_CHUNK_FRAMES) * 2];
+    float peaks[LIMITER_CHUNK_FRAMES * 2];
+    float gains[LIMITER_CHUNK_FRAMES];
+    // sliding window minimum of the required gain, as a monotonic deque
+    float deque_val[LIMITER_DEQUE_SIZE];
+    Uint32 deque_idx[LIMITER_DEQUE_SIZE];
+    Uint32 deque_head;
+    Uint32 deque_tail;
+    Uint32 frame_idx;
+    float release_gain;
+    // moving average over the lookahead turns the stepped minimum into a smooth attack
+    float box[LIMITER_LOOKAHEAD_FRAMES];
+    int box_pos;
+    double box_sum;
+} DspLimiterState;
+
+// WSOLA time-stretch: the input is cut into hann-windowed segments that are overlap-added at a fixed output hop. each
+// segment is taken from around its nominal input position (output position * tempo), nudged within a search window to
+// where it lines up best with the natural continuation of the previous segment
+#define STRETCH_SEG_FRAMES 1024
+#define STRETCH_HOP_FRAMES (STRETCH_SEG_FRAMES / 2)
+#define STRETCH_SEARCH_FRAMES 256
+#define STRETCH_SEARCH_COARSE_STEP 8
+#define STRETCH_IN_FRAMES 8192
+#define RESAMPLE_CHUNK_FRAMES 1024
+
+typedef void (*TimeStretchReadFn)(void* userdata, float* dst, int n_frames);
+
+// tagging struct so that it doesn't show up as unnamed in VSCode
+typedef struct TimeStretch {
+    SDL_bool active;
+    TimeStretchReadFn read;  // where the unstretched input comes from
+    void* read_userdata;
+    float window[STRETCH_SEG_FRAMES * 2];  // interleaved so both channels are windowed in one pass
+
+    // decoded input, interleaved stereo. positions below are frame offsets into this buffer
+    float in[STRETCH_IN_FRAMES * 2];
+    int in_frames;
+    double nominal_pos;
+    int prev_pos;  // where the last segment was taken from, can go negative once the input in front of it is dropped
+    SDL_bool have_prev;
+
+    float tail[STRETCH_HOP_FRAMES * 2];  // windowed second half of the last segment, waiting for its overlap partner
+    float out[STRETCH_HOP_FRAMES * 2];
+    int out_pos;  // frames of out already handed to the resampler
+
+    // linear interpolating resampler on top of the stretcher, for pitch shifting
+    float rs_buf[(RESAMPLE_CHUNK_FRAMES + 1) * 2];
+    int rs_frames;
+    double rs_pos;
+} TimeStretch;
+
+#define MAX_PLAYERS 8
+#define MAX_OUTPUTS MAX_PLAYERS
+#define MAX_DECODE_WORKERS 4
+#define DECODE_BUFFER_BYTES (64 * 1024)
+#define PLAYER_RING_FRAMES 32768  // power of two, ~0.7s at 48kHz
+#define PLAYER_REFILL_FRAMES (DECODE_BUFFER_BYTES / (int)(sizeof(float) * 2))
+#define PLAYER_LOW_WATER_FRAMES (PLAYER_RING_FRAMES / 2)
+#define DECODE_POLL_MS 20  // idle workers look at needs_refill this often, ~340ms of audio sits above the low water mark
+
+typedef struct AudioOutput AudioOutput;
+
+// one independent playback zone: its own file, gains, stretch and DSP chain. decoding happens on the shared worker pool
+// into a lock-free single producer/single consumer ring, so the audio callback never touches SDL_sound
+// tagging struct so that it doesn't show up as unnamed in VSCode
+typedef struct Player {
+    // decode side, only touched by whoever holds decode_lock (a decode worker or the UI thread)
+    SDL_mutex* decode_lock;
+    Sound_Sample* sample;
+    Uint32 available_samples;
+    Uint32 sample_pos;
+
+    // decoded frames, interleaved stereo. ring_write is only advanced by the decoder, ring_read only by the audio
+    // thread. both count frames and are allowed to wrap
+    float* ring;
+    SDL_atomic_t ring_write;
+    SDL_atomic_t ring_read;
+    SDL_atomic_t eof;  // the decoder has nothing more to put in the ring
+    SDL_atomic_t needs_refill;  // set by the audio thread when the ring drops below half, cleared by the worker
+
+    // parameters the UI thread publishes, floats stored as their bit pattern
+    SDL_atomic_t paused;
+    SDL_atomic_t volume_target;
+    SDL_atomic_t balance_target;
+    SDL_atomic_t speed_target;  // 1.0 is normal
+    SDL_atomic_t pitch_target;  // ratio, 1.0 is unchanged
+
+    // audio thread only, except while the output device is locked
+    TimeStretch stretch;
+    DspGainState volume_state;
+    DspGainState balance_state;
+    DspStage volume_stage;
+    DspStage balance_stage;
+    DspChainSlot chain;
+
+    // UI thread only, what the sliders go back to when this player gets the UI
+    float volume;
+    float balance;
+    int pitch_semitones;
+
+    AudioOutput* output;
+} Player;
+
+// one opened audio device, mixing every player routed to it. the bus has its own DSP chain (the limiter) and does the
+// conversion to integer device formats
+// tagging struct so that it doesn't show up as unnamed in VSCode
+typedef struct AudioOutput {
+    SDL_AudioDeviceID device;
+    const char* device_name;  // NULL for the system default
+    SDL_AudioFormat format;
+    int buf_frames;
+    float* mix_buf;  // bus mix for integer formats, F32 devices are mixed straight into the stream
+    float* player_buf;  // scratch each player renders into before being summed
+    Player* players[MAX_PLAYERS];  // only changed while the device is locked
+    int n_players;
+    DspLimiterState limiter_state;
+    DspStage limiter_stage;
+    DspChainSlot chain;
+    SDL_bool idle;  // audio thread only, nobody played last block and the bus chain has been reset
+    Uint32 dither_seed[4];
+} AudioOutput;
+
 static Sound_AudioInfo audio_device_spec;
 
 static SDL_Window* window = NULL;  // any time you need to draw to screen in sdl, you need a window
 static SDL_Renderer* renderer = NULL;
+// the skin gets composited at 1x into this, then copied to the window scaled in one go
+static SDL_Texture* canvas = NULL;
+static float ui_scale = 1.0f;  // window pixels per skin pixel, SDLAMP_SCALE=2, 3, 1.5...
 // don't have to initialize static variable to null?
 static SDL_AudioSpec desired;
 
 static WinampSkin skin;
 
-static Sound_Sample* cur_sample = NULL;
-static Uint32 available_samples;
-static Uint32 sample_pos;
+static InputTape input_tape;
+static FrameTiming* frame_timings;
+static int n_frame_timings;
+static int max_frame_timings;
+
+// every player/output is created at startup and lives until shutdown, so workers can walk these without locking
+static Player* players[MAX_PLAYERS];
+static int n_players;
+static AudioOutput* outputs[MAX_OUTPUTS];
+static int n_outputs;
+static Player* ui_player = NULL;  // the player the skin is currently controlling
+
+static SDL_Thread* decode_workers[MAX_DECODE_WORKERS];
+static int n_decode_workers;
+static SDL_sem* decode_wakeup = NULL;
+static SDL_atomic_t decode_quit;
 
-static SDL_bool paused = SDL_TRUE;
+static Uint64 perf_freq;
 
 static SDL_bool winshade_mode = SDL_FALSE;
 
@@ -116,120 +431,905 @@ static void panic_and_abort(const char* title, const char* text) {
     exit(1);
 }
 
-static void stop_audio(void) {
-    Sound_Sample* sample = cur_sample;
-    if (sample) {
-        SDL_LockAudioDevice(audio_device);
-        cur_sample = NULL;  // NOTE: should this be atomic (it is in tutorial code)? why?
-        SDL_UnlockAudioDevice(audio_device);
-        Sound_FreeSample(sample);
+SDL_COMPILE_TIME_ASSERT(float_fits_atomic, sizeof(float) == sizeof(int));
+
+static SDL_INLINE void atomic_set_float(SDL_atomic_t* a, const float val) {
+    int bits;
+    SDL_memcpy(&bits, &val, sizeof(bits));
+    SDL_AtomicSet(a, bits);
+}
+
+static SDL_INLINE float atomic_get_float(SDL_atomic_t* a) {
+    const int bits = SDL_AtomicGet(a);
+    float val;
+    SDL_memcpy(&val, &bits, sizeof(val));
+    return val;
+}
+
+// drops everything queued for playback. the caller holds decode_lock, this takes the device lock so the audio thread
+// can't be halfway through reading the ring
+static void player_flush(Player* player) {
+    SDL_LockAudioDevice(player->output->device);
+    SDL_AtomicSet(&player->ring_read, 0);
+    SDL_AtomicSet(&player->ring_write, 0);
+    player->stretch.active = SDL_FALSE;
+    SDL_UnlockAudioDevice(player->output->device);
+}
+
+static void stop_audio(Player* player) {
+    SDL_LockMutex(player->decode_lock);
+    if (player->sample) {
+        Sound_FreeSample(player->sample);
+        player->sample = NULL;
     }
-    available_samples = 0;
-    sample_pos = 0;
+    player->available_samples = 0;
+    player->sample_pos = 0;
+    SDL_AtomicSet(&player->eof, 1);
+    player_flush(player);
+    SDL_UnlockMutex(player->decode_lock);
 }
 
-static SDL_bool open_new_audio_file(char* fname) {
+static SDL_bool open_new_audio_file(Player* player, const char* fname) {
 
-    stop_audio();
-    SDL_assert(cur_sample == NULL);  // stop_audio should have set it to null
+    stop_audio(player);
 
-    Sound_Sample* sample = Sound_NewSampleFromFile(fname, &audio_device_spec, 64 * 1024);
+    Sound_Sample* sample = Sound_NewSampleFromFile(fname, &audio_device_spec, DECODE_BUFFER_BYTES);
     if (!sample) {
         SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "couldn't load audio file", Sound_GetError(), window);
         return SDL_FALSE;
     }
 
-    // lock the audio device here so the callback can't touch "sample" global between lock/unlock
-    SDL_LockAudioDevice(audio_device);
-    cur_sample = sample;
-    SDL_UnlockAudioDevice(audio_device);
+    // hold the decode lock so no worker sees the sample before it's fully handed over
+    SDL_LockMutex(player->decode_lock);
+    player->sample = sample;
+    SDL_AtomicSet(&player->eof, 0);
+    SDL_UnlockMutex(player->decode_lock);
+    SDL_SemPost(decode_wakeup);
 
     return SDL_TRUE;
 }
 
-static void SDLCALL feed_audio_device_callback(void* __attribute__((unused)) userdata, Uint8* output_stream, int len) {
+// multiplies interleaved stereo samples by a gain that moves linearly from (l0, r0) to (l1, r1) across the block, so a
+// slider drag never turns into an audible step ("zipper noise") at block boundaries
+static void apply_stereo_gain_ramp(float* samples, const int n_frames, float l0, float r0, const float l1, const float r1) {
+    if (n_frames <= 0) {
+        return;
+    }
+    const float dl = (l1 - l0) / n_frames;
+    const float dr = (r1 - r0) / n_frames;
+    int i = 0;
+
+#ifdef __SSE__
+    // two stereo frames per vector: {l, r, l + dl, r + dr}, stepping by two frames each iteration
+    __m128 gain = _mm_setr_ps(l0, r0, l0 + dl, r0 + dr);
+    const __m128 step = _mm_setr_ps(2.0f * dl, 2.0f * dr, 2.0f * dl, 2.0f * dr);
+    for (; i + 2 <= n_frames; i += 2) {
+        float* ptr = samples + (i * 2);
+        _mm_storeu_ps(ptr, _mm_mul_ps(_mm_loadu_ps(ptr), gain));
+        gain = _mm_add_ps(gain, step);
+    }
+    l0 += dl * i;
+    r0 += dr * i;
+#endif
+
+    for (; i < n_frames; i++) {
+        samples[i * 2] *= l0;
+        samples[i * 2 + 1] *= r0;
+        l0 += dl;
+        r0 += dr;
+    }
+}
+
+static void volume_stage_process(DspStage* stage, float* interleaved, const int n_frames) {
+    DspGainState* state = (DspGainState*)stage->userdata;
+    const float target = atomic_get_float(state->target);
+    if (state->cur_l != 1.0f || target != 1.0f) {
+        apply_stereo_gain_ramp(interleaved, n_frames, state->cur_l, state->cur_r, target, target);
+    }
+    state->cur_l = state->cur_r = target;
+}
+
+static void balance_stage_process(DspStage* stage, float* interleaved, const int n_frames) {
+    DspGainState* state = (DspGainState*)stage->userdata;
+    // balance at 0.5 leaves both channels alone, moving it off center fades the opposite channel out linearly
+    const float balance = atomic_get_float(state->target);
+    const float target_l = (balance > 0.5f) ? 2.0f * (1.0f - balance) : 1.0f;
+    const float target_r = (balance < 0.5f) ? 2.0f * balance : 1.0f;
+    if (state->cur_l != 1.0f || state->cur_r != 1.0f || target_l != 1.0f || target_r != 1.0f) {
+        apply_stereo_gain_ramp(interleaved, n_frames, state->cur_l, state->cur_r, target_l, target_r);
+    }
+    state->cur_l = target_l;
+    state->cur_r = target_r;
+}
+
+// bypassed gain stages pass audio through at unity, so that's where the ramp resumes from
+static void gain_stage_reset(DspStage* stage) {
+    DspGainState* state = (DspGainState*)stage->userdata;
+    state->cur_l = state->cur_r = 1.0f;
+}
+
+static void limiter_stage_reset(DspStage* stage) {
+    DspLimiterState* state = (DspLimiterState*)stage->userdata;
+    SDL_zeroa(state->buf);
+    state->deque_head = state->deque_tail = 0;
+    state->frame_idx = 0;
+    state->release_gain = 1.0f;
+    for (int i = 0; i < LIMITER_LOOKAHEAD_FRAMES; i++) {
+        state->box[i] = 1.0f;
+    }
+    state->box_pos = 0;
+    state->box_sum = LIMITER_LOOKAHEAD_FRAMES;
+}
+
+// catmull-rom weights for points p0..p3 at t = 0.25, 0.5 and 0.75 between p1 and p2
+static const float true_peak_weights[3][4] = {
+        {-0.0703125f, 0.8671875f, 0.2265625f, -0.0234375f},
+        {-0.0625f, 0.5625f, 0.5625f, -0.0625f},
+        {-0.0234375f, 0.2265625f, 0.8671875f, -0.0703125f},
+};
+
+// peaks[i] is the larger of |x| at sample i and the interpolated peaks between the two samples before it
+static void limiter_detect_peaks(const float* x, float* peaks, const int n_samples) {
+    int i = 0;
+#ifdef __SSE__
+    const __m128 sign_mask = _mm_set1_ps(-0.0f);
+    for (; i + 4 <= n_samples; i += 4) {
+        const __m128 p0 = _mm_loadu_ps(x + i - 6);
+        const __m128 p1 = _mm_loadu_ps(x + i - 4);
+        const __m128 p2 = _mm_loadu_ps(x + i - 2);
+        const __m128 p3 = _mm_loadu_ps(x + i);
+        __m128 peak = _mm_andnot_ps(sign_mask, p3);
+        for (int t = 0; t < 3; t++) {
+            const float* w = true_peak_weights[t];
+            __m128 v = _mm_mul_ps(p0, _mm_set1_ps(w[0]));
+            v = _mm_add_ps(v, _mm_mul_ps(p1, _mm_set1_ps(w[1])));
+            v = _mm_add_ps(v, _mm_mul_ps(p2, _mm_set1_ps(w[2])));
+            v = _mm_add_ps(v, _mm_mul_ps(p3, _mm_set1_ps(w[3])));
+            peak = _mm_max_ps(peak, _mm_andnot_ps(sign_mask, v));
+        }
+        _mm_storeu_ps(peaks + i, peak);
+    }
+#endif
+    for (; i < n_samples; i++) {
+        float peak = SDL_fabsf(x[i]);
+        for (int t = 0; t < 3; t++) {
+            const float* w = true_peak_weights[t];
+            const float v = x[i - 6] * w[0] + x[i - 4] * w[1] + x[i - 2] * w[2] + x[i] * w[3];
+            peak = SDL_max(peak, SDL_fabsf(v));
+        }
+        peaks[i] = peak;
+    }
+}
+
+static void apply_frame_gains(float* samples, const float* gains, const int n_frames) {
+    int i = 0;
+#ifdef __SSE__
+    for (; i + 4 <= n_frames; i += 4) {
+        const __m128 g = _mm_loadu_ps(gains + i);
+        float* ptr = samples + i * 2;
+        _mm_storeu_ps(ptr, _mm_mul_ps(_mm_loadu_ps(ptr), _mm_unpacklo_ps(g, g)));
+        _mm_storeu_ps(ptr + 4, _mm_mul_ps(_mm_loadu_ps(ptr + 4), _mm_unpackhi_ps(g, g)));
+    }
+#endif
+    for (; i < n_frames; i++) {
+        samples[i * 2] *= gains[i];
+        samples[i * 2 + 1] *= gains[i];
+    }
+}
+
+static void limiter_process_chunk(DspLimiterState* state, float* interleaved, const int n_frames) {
+    float* incoming = state->buf + LIMITER_DELAY_FRAMES * 2;
+    SDL_memcpy(incoming, interleaved, n_frames * 2 * sizeof(float));
+    limiter_detect_peaks(incoming, state->peaks, n_frames * 2);
+
+    // the envelope is inherently sequential, everything around it is vectorized
+    for (int i = 0; i < n_frames; i++) {
+        const float peak = SDL_max(state->peaks[i * 2], state->peaks[i * 2 + 1]);
+        const float required = (peak > state->ceiling) ? state->ceiling / peak : 1.0f;
+        const Uint32 idx = state->frame_idx++;
+
+        while (state->deque_tail != state->deque_head
+               && state->deque_val[(state->deque_tail - 1) & (LIMITER_DEQUE_SIZE - 1)] >= required) {
+            state->deque_tail--;
+        }
+        state->deque_val[state->deque_tail & (LIMITER_DEQUE_SIZE - 1)] = required;
+        state->deque_idx[state->deque_tail & (LIMITER_DEQUE_SIZE - 1)] = idx;
+        state->deque_tail++;
+        if (idx - state->deque_idx[state->deque_head & (LIMITER_DEQUE_SIZE - 1)] >= LIMITER_WINDOW_FRAMES) {
+            state->deque_head++;
+        }
+        const float window_min = state->deque_val[state->deque_head & (LIMITER_DEQUE_SIZE - 1)];
+
+        // instant attack, exponential release
+        if (window_min < state->release_gain) {
+            state->release_gain = window_min;
+        } else {
+            state->release_gain += (window_min - state->release_gain) * state->release_coeff;
+        }
+
+        state->box_sum += state->release_gain - state->box[state->box_pos];
+        state->box[state->box_pos] = state->release_gain;
+        state->box_pos = (state->box_pos + 1) % LIMITER_LOOKAHEAD_FRAMES;
+        state->gains[i] = (float)(state->box_sum / LIMITER_LOOKAHEAD_FRAMES);
+    }
+
+    SDL_memcpy(interleaved, state->buf, n_frames * 2 * sizeof(float));
+    apply_frame_gains(interleaved, state->gains, n_frames);
+    SDL_memmove(state->buf, state->buf + n_frames * 2, LIMITER_DELAY_FRAMES * 2 * sizeof(float));
+}
+
+static void limiter_stage_process(DspStage* stage, float* interleaved, int n_frames) {
+    DspLimiterState* state = (DspLimiterState*)stage->userdata;
+    while (n_frames > 0) {
+        const int chunk = SDL_min(n_frames, LIMITER_CHUNK_FRAMES);
+        limiter_process_chunk(state, interleaved, chunk);
+        interleaved += chunk * 2;
+        n_frames -= chunk;
+    }
+}
+
+static void init_dsp_stage(DspStage* stage, const char* name, DspProcessFn process, DspResetFn reset, void* userdata) {
+    SDL_zerop(stage);
+    stage->name = name;
+    stage->process = process;
+    stage->reset = reset;
+    stage->userdata = userdata;
+}
+
+static void dsp_set_bypass(DspStage* stage, const SDL_bool bypass) { SDL_AtomicSet(&stage->bypass, bypass ? 1 : 0); }
+
+static void dsp_get_timing(DspStage* stage, int* last_usecs, int* peak_usecs) {
+    *last_usecs = SDL_AtomicGet(&stage->last_usecs);
+    *peak_usecs = SDL_AtomicGet(&stage->peak_usecs);
+}
 
-    Sound_Sample* sample = cur_sample;  // NOTE: ryan uses atomicgetptr here -- why?
+// UI thread: frees whatever chain the audio thread has finished with
+static void dsp_collect_retired_chain(DspChainSlot* slot) { SDL_free(SDL_AtomicSetPtr(&slot->retired, NULL)); }
 
-    if (sample == NULL) {
-        SDL_memset(output_stream, '\0', len);
+// UI thread: builds a chain from a list of stages and queues it for the audio thread. never waits on the callback
+static SDL_bool dsp_publish_chain(DspChainSlot* slot, DspStage** stages, const int n_stages) {
+    if (n_stages > DSP_MAX_STAGES) {
+        SDL_SetError("too many DSP stages (%d, max is %d)", n_stages, DSP_MAX_STAGES);
+        return SDL_FALSE;
+    }
+
+    DspChain* chain = (DspChain*)SDL_calloc(1, sizeof(DspChain));
+    if (!chain) {
+        SDL_OutOfMemory();
+        return SDL_FALSE;
+    }
+    chain->n_stages = n_stages;
+    SDL_memcpy(chain->stages, stages, n_stages * sizeof(DspStage*));
+
+    dsp_collect_retired_chain(slot);
+    // if the audio thread never picked up the previous pending chain, it's safe to just throw it away
+    SDL_free(SDL_AtomicSetPtr(&slot->pending, chain));
+    return SDL_TRUE;
+}
+
+// audio thread: picks up a newly published chain, but only once the last retired one has been collected so a chain
+// is never dropped without being freed
+static DspChain* dsp_acquire_chain(DspChainSlot* slot) {
+    if (SDL_AtomicGetPtr(&slot->retired) == NULL) {
+        DspChain* chain = (DspChain*)SDL_AtomicSetPtr(&slot->pending, NULL);
+        if (chain) {
+            SDL_AtomicSetPtr(&slot->retired, slot->active);
+            slot->active = chain;
+        }
+    }
+    return slot->active;
+}
+
+// audio thread: clears every stage's history (delay lines and such), e.g. when the stream it was fed stops
+static void dsp_reset_chain(DspChain* chain) {
+    if (chain == NULL) {
         return;
     }
+    for (int i = 0; i < chain->n_stages; i++) {
+        if (chain->stages[i]->reset) {
+            chain->stages[i]->reset(chain->stages[i]);
+        }
+    }
+}
 
-    const float volume = skin.sliders[SLD_VOLUME].val;
-    const float balance = skin.sliders[SLD_BALANCE].val;
+static void dsp_run_chain(DspChain* chain, float* interleaved, const int n_frames) {
+    if (chain == NULL) {
+        return;
+    }
 
-    while (len > 0) {
-        if (available_samples == 0) {
-            const Uint32 br = Sound_Decode(sample);
-            if (br == 0) {
-                // !!! fixme: rework stop_audio, use it here
-                Sound_FreeSample(cur_sample);
-                cur_sample = NULL;  // NOTE: this is atomically set in ryan code
-                available_samples = 0;
-                sample_pos = 0;
-                SDL_memset(output_stream, '\0', len);
-                return;
+    for (int i = 0; i < chain->n_stages; i++) {
+        DspStage* stage = chain->stages[i];
+        if (SDL_AtomicGet(&stage->bypass)) {
+            stage->was_bypassed = SDL_TRUE;
+            continue;
+        }
+        if (stage->was_bypassed) {
+            stage->was_bypassed = SDL_FALSE;
+            if (stage->reset) {
+                stage->reset(stage);
             }
-            available_samples = br;
-            sample_pos = 0;
         }
 
-        // cpy: number of samples to copy from cur_sample buffer into output_stream
-        const Uint32 cpy = SDL_min(available_samples, (Uint32)len);
-        SDL_assert(cpy > 0);
-        SDL_memcpy(output_stream, (const Uint8*)sample->buffer + sample_pos, (size_t)cpy);
+        const Uint64 start = SDL_GetPerformanceCounter();
+        stage->process(stage, interleaved, n_frames);
+        const int usecs = (int)(((SDL_GetPerformanceCounter() - start) * 1000000) / perf_freq);
+
+        SDL_AtomicSet(&stage->last_usecs, usecs);
+        if (usecs > SDL_AtomicGet(&stage->peak_usecs)) {
+            SDL_AtomicSet(&stage->peak_usecs, usecs);
+        }
+    }
+}
+
+// UI thread, only safe once the audio device is closed
+static void dsp_free_chains(DspChainSlot* slot) {
+    SDL_free(slot->active);
+    SDL_free(SDL_AtomicSetPtr(&slot->pending, NULL));
+    SDL_free(SDL_AtomicSetPtr(&slot->retired, NULL));
+    slot->active = NULL;
+}
+
+// SDLAMP_DSP_BYPASS="volume,balance" bypasses stages by name, handy for profiling the chain
+static void apply_bypass_env(DspStage** stages, const int n_stages) {
+    const char* bypass_list = SDL_getenv("SDLAMP_DSP_BYPASS");
+    if (!bypass_list) {
+        return;
+    }
+    for (int i = 0; i < n_stages; i++) {
+        const size_t name_len = SDL_strlen(stages[i]->name);
+        for (const char* ptr = bypass_list; ptr; ptr = SDL_strchr(ptr, ',')) {
+            ptr += (*ptr == ',') ? 1 : 0;
+            if (SDL_strncmp(ptr, stages[i]->name, name_len) == 0 && (ptr[name_len] == ',' || ptr[name_len] == '\0')) {
+                dsp_set_bypass(stages[i], SDL_TRUE);
+            }
+        }
+    }
+}
+
+static void init_player_dsp(Player* player) {
+    player->volume_state = (DspGainState){&player->volume_target, 1.0f, 1.0f};
+    player->balance_state = (DspGainState){&player->balance_target, 1.0f, 1.0f};
+    init_dsp_stage(&player->volume_stage, "volume", volume_stage_process, gain_stage_reset, &player->volume_state);
+    init_dsp_stage(&player->balance_stage, "balance", balance_stage_process, gain_stage_reset, &player->balance_state);
+
+    DspStage* stages[] = {&player->volume_stage, &player->balance_stage};
+    apply_bypass_env(stages, (int)SDL_arraysize(stages));
+    if (!dsp_publish_chain(&player->chain, stages, (int)SDL_arraysize(stages))) {
+        panic_and_abort("Couldn't build DSP chain", SDL_GetError());
+    }
+}
+
+// the limiter only goes on the integer outputs we dither ourselves (or F32 with SDLAMP_LIMITER=1). the default F32
+// path stays bit-exact and doesn't pick up the lookahead latency
+static void init_output_dsp(AudioOutput* output, const int freq) {
+    const char* limiter_hint = SDL_getenv("SDLAMP_LIMITER");
+    const SDL_bool use_limiter = (output->format != AUDIO_F32 || (limiter_hint && SDL_atoi(limiter_hint) != 0))
+                                         ? SDL_TRUE
+                                         : SDL_FALSE;
+
+    // -1 dBTP ceiling, 50ms release
+    output->limiter_state.ceiling = SDL_powf(10.0f, -1.0f / 20.0f);
+    output->limiter_state.release_coeff = 1.0f - SDL_expf(-1.0f / (0.05f * freq));
+    init_dsp_stage(&output->limiter_stage, "limiter", limiter_stage_process, limiter_stage_reset, &output->limiter_state);
+    limiter_stage_reset(&output->limiter_stage);
+
+    DspStage* stages[] = {&output->limiter_stage};
+    const int n_stages = use_limiter ? (int)SDL_arraysize(stages) : 0;
+    apply_bypass_env(stages, n_stages);
+    if (!dsp_publish_chain(&output->chain, stages, n_stages)) {
+        panic_and_abort("Couldn't build DSP chain", SDL_GetError());
+    }
+}
+
+static void dsp_log_timings(DspChainSlot* slot, const char* owner) {
+    if (slot->active == NULL) {
+        return;
+    }
+    for (int i = 0; i < slot->active->n_stages; i++) {
+        int last_usecs, peak_usecs;
+        dsp_get_timing(slot->active->stages[i], &last_usecs, &peak_usecs);
+        SDL_Log("%s dsp stage '%s': last %dus, peak %dus", owner, slot->active->stages[i]->name, last_usecs, peak_usecs);
+    }
+}
+
+static SDL_INLINE int player_ring_fill(Player* player) {
+    return (int)((Uint32)SDL_AtomicGet(&player->ring_write) - (Uint32)SDL_AtomicGet(&player->ring_read));
+}
 
-        float* samples = (float*)output_stream;
-        const int n_samples = cpy / sizeof(float);  // we are using F32 samples as specified in desired.format
-        SDL_assert((n_samples % 2) == 0);
+// decode worker, with decode_lock held: moves one chunk of decoded audio into the ring. returns SDL_FALSE if there
+// was nothing worth doing
+static SDL_bool player_decode_some(Player* player) {
+    if (player->sample == NULL) {
+        return SDL_FALSE;
+    }
+    const int space = PLAYER_RING_FRAMES - player_ring_fill(player);
+    if (space < PLAYER_REFILL_FRAMES) {
+        return SDL_FALSE;
+    }
 
-        // changing volume here
-        for (int i = 0; i < n_samples; i++) {
-            samples[i] *= volume;
+    if (player->available_samples == 0) {
+        const Uint32 br = Sound_Decode(player->sample);
+        if (br == 0) {
+            Sound_FreeSample(player->sample);
+            player->sample = NULL;
+            SDL_AtomicSet(&player->eof, 1);
+            return SDL_TRUE;
         }
+        player->available_samples = br;
+        player->sample_pos = 0;
+    }
+
+    const int frame_size = (int)(sizeof(float) * 2);
+    const int n_frames = SDL_min((int)player->available_samples / frame_size, space);
+    if (n_frames == 0) {
+        player->available_samples = 0;  // a partial frame, drop it rather than spin on it
+        return SDL_TRUE;
+    }
+    const Uint32 write = (Uint32)SDL_AtomicGet(&player->ring_write);
+    const int start = (int)(write & (PLAYER_RING_FRAMES - 1));
+    const int first = SDL_min(n_frames, PLAYER_RING_FRAMES - start);
+    const Uint8* src = (const Uint8*)player->sample->buffer + player->sample_pos;
+    SDL_memcpy(player->ring + start * 2, src, first * frame_size);
+    SDL_memcpy(player->ring, src + first * frame_size, (n_frames - first) * frame_size);
+
+    // SDL's atomic set is a full barrier, so the frames are visible before the new write position is
+    SDL_AtomicSet(&player->ring_write, (int)(write + n_frames));
+    player->available_samples -= n_frames * frame_size;
+    player->sample_pos += n_frames * frame_size;
+    return SDL_TRUE;
+}
 
-        // changing balance here
-        if (balance > 0.5f) {  // left samples
-            for (int i = 0; i < n_samples; i += 2) {
-                samples[i] *= 1.0f - balance;
+static int SDLCALL decode_worker(void* __attribute__((unused)) data) {
+    while (!SDL_AtomicGet(&decode_quit)) {
+        SDL_bool did_work = SDL_FALSE;
+        for (int i = 0; i < n_players; i++) {
+            Player* player = players[i];
+            // another worker (or the UI) already has this one, Sound_Sample isn't safe to share
+            if (SDL_TryLockMutex(player->decode_lock) != 0) {
+                continue;
+            }
+            SDL_AtomicSet(&player->needs_refill, 0);
+            if (player_decode_some(player)) {
+                did_work = SDL_TRUE;
             }
-        } else if (balance < 0.5f) {  // right samples
-            for (int i = 0; i < n_samples; i += 2) {
-                samples[i + 1] *= balance;
+            SDL_UnlockMutex(player->decode_lock);
+        }
+        if (!did_work) {
+            // the audio thread can't post decode_wakeup (that can take a lock on some platforms), it only raises
+            // needs_refill, so don't sleep a full poll through a raised flag. still waits a little in case the flag
+            // belongs to a player somebody else has locked
+            SDL_bool refill_pending = SDL_FALSE;
+            for (int i = 0; i < n_players; i++) {
+                if (SDL_AtomicGet(&players[i]->needs_refill)) {
+                    refill_pending = SDL_TRUE;
+                }
             }
+            SDL_SemWaitTimeout(decode_wakeup, refill_pending ? 1 : DECODE_POLL_MS);
         }
+    }
+    return 0;
+}
 
-        len -= cpy;
-        available_samples -= cpy;
-        sample_pos += cpy;
+// audio thread: fills dst with decoded interleaved stereo frames, padding with silence if the decoder fell behind or
+// the file ran out
+static void player_read_frames(void* userdata, float* dst, const int n_frames) {
+    Player* player = (Player*)userdata;
+    const int fill = player_ring_fill(player);
+    const int n_read = SDL_min(fill, n_frames);
+    const Uint32 read = (Uint32)SDL_AtomicGet(&player->ring_read);
+    const int start = (int)(read & (PLAYER_RING_FRAMES - 1));
+    const int first = SDL_min(n_read, PLAYER_RING_FRAMES - start);
+    SDL_memcpy(dst, player->ring + start * 2, first * 2 * sizeof(float));
+    SDL_memcpy(dst + first * 2, player->ring, (n_read - first) * 2 * sizeof(float));
+    SDL_memset(dst + n_read * 2, '\0', (n_frames - n_read) * 2 * sizeof(float));
+    SDL_AtomicSet(&player->ring_read, (int)(read + n_read));
+
+    // only an atomic store here, no SDL sync calls: semaphores are a mutex + condvar on some platforms. raised once
+    // when the fill crosses the low water mark, the workers pick it up on their next poll
+    if (fill >= PLAYER_LOW_WATER_FRAMES && fill - n_read < PLAYER_LOW_WATER_FRAMES && !SDL_AtomicGet(&player->eof)) {
+        SDL_AtomicSet(&player->needs_refill, 1);
     }
 }
 
-SDL_HitTestResult SDLCALL hittest_callback(SDL_Window* window, const SDL_Point* area, void* data) {
-    if (area->y >= 14) {
-        return SDL_HITTEST_NORMAL;
+static float dot_product(const float* a, const float* b, const int n) {
+    float sum = 0.0f;
+    int i = 0;
+#ifdef __SSE__
+    __m128 acc = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+    for (; i < n; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+// out = tail + seg * win over the first half, tail = seg * win over the second half
+static void overlap_add(float* out, float* tail, const float* seg, const float* win, const int n) {
+    int i = 0;
+#ifdef __SSE__
+    for (; i + 4 <= n; i += 4) {
+        const __m128 head = _mm_mul_ps(_mm_loadu_ps(seg + i), _mm_loadu_ps(win + i));
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(tail + i), head));
+        _mm_storeu_ps(tail + i, _mm_mul_ps(_mm_loadu_ps(seg + n + i), _mm_loadu_ps(win + n + i)));
+    }
+#endif
+    for (; i < n; i++) {
+        out[i] = tail[i] + seg[i] * win[i];
+        tail[i] = seg[n + i] * win[n + i];
+    }
+}
+
+// normalized cross-correlation of the candidate segment's overlap region against the reference
+static float stretch_similarity(const float* candidate, const float* ref) {
+    const int n = STRETCH_HOP_FRAMES * 2;
+    return dot_product(candidate, ref, n) / SDL_sqrtf(dot_product(candidate, candidate, n) + 1e-9f);
+}
+
+static int stretch_search(TimeStretch* ts, const int lo, const int hi, const int step, int best) {
+    const float* ref = ts->in + (ts->prev_pos + STRETCH_HOP_FRAMES) * 2;
+    float best_score = stretch_similarity(ts->in + best * 2, ref);
+    for (int pos = lo; pos <= hi; pos += step) {
+        const float score = stretch_similarity(ts->in + pos * 2, ref);
+        if (score > best_score) {
+            best_score = score;
+            best = pos;
+        }
+    }
+    return best;
+}
+
+static void init_timestretch(TimeStretch* ts, TimeStretchReadFn read, void* read_userdata) {
+    SDL_zerop(ts);
+    ts->read = read;
+    ts->read_userdata = read_userdata;
+    for (int i = 0; i < STRETCH_SEG_FRAMES; i++) {
+        // periodic hann, so windows at 50% overlap sum to exactly 1
+        const float w = 0.5f - 0.5f * SDL_cosf(2.0f * (float)M_PI * i / STRETCH_SEG_FRAMES);
+        ts->window[i * 2] = ts->window[i * 2 + 1] = w;
+    }
+}
+
+static void timestretch_reset(TimeStretch* ts) {
+    ts->in_frames = 0;
+    ts->nominal_pos = 0.0;
+    ts->prev_pos = 0;
+    ts->have_prev = SDL_FALSE;
+    SDL_zeroa(ts->tail);
+    ts->out_pos = STRETCH_HOP_FRAMES;
+    // resampler starts out empty, positioned so the first refilled frame comes out exactly
+    ts->rs_frames = 1;
+    ts->rs_pos = 1.0;
+    SDL_zeroa(ts->rs_buf);
+    ts->active = SDL_TRUE;
+}
+
+// produces the next STRETCH_HOP_FRAMES output frames into ts->out
+static void timestretch_process_hop(TimeStretch* ts, const float tempo) {
+    const int nominal = (int)ts->nominal_pos;
+    const int needed = nominal + STRETCH_SEARCH_FRAMES + STRETCH_SEG_FRAMES;
+    SDL_assert(needed <= STRETCH_IN_FRAMES);
+    if (ts->in_frames < needed) {
+        ts->read(ts->read_userdata, ts->in + ts->in_frames * 2, needed - ts->in_frames);
+        ts->in_frames = needed;
+    }
+
+    int best = nominal;
+    if (!ts->have_prev) {
+        // nothing to overlap with yet (just switched in from unstretched playback, or drained back to raw input), so
+        // make the tail the complement of the first segment's fade in: the first hop then comes out as the input
+        // itself instead of fading in from silence
+        const float* seg = ts->in + best * 2;
+        for (int i = 0; i < STRETCH_HOP_FRAMES * 2; i++) {
+            ts->tail[i] = seg[i] * (1.0f - ts->window[i]);
+        }
+    } else {
+        // coarse pass over the whole search window, then refine around the winner
+        const int lo = SDL_max(nominal - STRETCH_SEARCH_FRAMES, 0);
+        const int hi = nominal + STRETCH_SEARCH_FRAMES;
+        best = stretch_search(ts, lo, hi, STRETCH_SEARCH_COARSE_STEP, best);
+        const int fine_lo = SDL_max(best - STRETCH_SEARCH_COARSE_STEP + 1, lo);
+        const int fine_hi = SDL_min(best + STRETCH_SEARCH_COARSE_STEP - 1, hi);
+        best = stretch_search(ts, fine_lo, fine_hi, 1, best);
+    }
+
+    overlap_add(ts->out, ts->tail, ts->in + best * 2, ts->window, STRETCH_HOP_FRAMES * 2);
+    ts->out_pos = 0;
+    ts->prev_pos = best;
+    ts->have_prev = SDL_TRUE;
+    ts->nominal_pos += STRETCH_HOP_FRAMES * tempo;
+
+    // drop input that neither the next reference nor the next search window can reach
+    const int keep_from = SDL_min(ts->prev_pos + STRETCH_HOP_FRAMES, (int)ts->nominal_pos - STRETCH_SEARCH_FRAMES);
+    if (keep_from > 0) {
+        ts->in_frames -= keep_from;
+        SDL_memmove(ts->in, ts->in + keep_from * 2, ts->in_frames * 2 * sizeof(float));
+        ts->nominal_pos -= keep_from;
+        ts->prev_pos -= keep_from;
     }
+}
 
-    // check all buttons in winshade mode, only titlebar buttons otherwise (in winshade mode all buttons are titlebar
-    // buttons)
-    if (winshade_mode) {
-        for (int i = 0; i < (int)SDL_arraysize(skin.winshade_buttons); i++) {
-            const SDL_Rect dest_rect = skin.winshade_buttons[i].dest_rect;
-            if (SDL_PointInRect(area, &dest_rect)) {
-                return SDL_HITTEST_NORMAL;
+static void timestretch_read(TimeStretch* ts, float* dst, int n_frames, const float tempo) {
+    while (n_frames > 0) {
+        if (ts->out_pos == STRETCH_HOP_FRAMES) {
+            timestretch_process_hop(ts, tempo);
+        }
+        const int cpy = SDL_min(n_frames, STRETCH_HOP_FRAMES - ts->out_pos);
+        SDL_memcpy(dst, ts->out + ts->out_pos * 2, cpy * 2 * sizeof(float));
+        dst += cpy * 2;
+        n_frames -= cpy;
+        ts->out_pos += cpy;
+    }
+}
+
+// playing the stretched audio back at pitch_ratio times the rate shifts its pitch (and speed, which the caller has
+// already compensated for in the tempo)
+static void timestretch_render(TimeStretch* ts, float* dst, const int n_frames, const float speed, const float pitch) {
+    const float tempo = speed / pitch;
+    for (int i = 0; i < n_frames; i++) {
+        if (ts->rs_pos + 1.0 >= ts->rs_frames) {
+            if (pitch == 1.0f) {
+                // unity pitch skips the resampler once it has played out what it held, leaving it empty and ready to
+                // pick up seamlessly if the pitch changes again
+                timestretch_read(ts, dst + i * 2, n_frames - i, tempo);
+                ts->rs_buf[0] = dst[(n_frames - 1) * 2];
+                ts->rs_buf[1] = dst[(n_frames - 1) * 2 + 1];
+                ts->rs_frames = 1;
+                ts->rs_pos = 1.0;
+                return;
             }
+            // keep the last frame around so we can interpolate across the refill
+            ts->rs_buf[0] = ts->rs_buf[(ts->rs_frames - 1) * 2];
+            ts->rs_buf[1] = ts->rs_buf[(ts->rs_frames - 1) * 2 + 1];
+            ts->rs_pos -= ts->rs_frames - 1;
+            timestretch_read(ts, ts->rs_buf + 2, RESAMPLE_CHUNK_FRAMES, tempo);
+            ts->rs_frames = RESAMPLE_CHUNK_FRAMES + 1;
         }
-        if (SDL_PointInRect(area, &skin.winshade_slider.dest_rect)) {
-            return SDL_HITTEST_NORMAL;
+        const int idx = (int)ts->rs_pos;
+        const float frac = (float)(ts->rs_pos - idx);
+        const float* frame = ts->rs_buf + idx * 2;
+        dst[i * 2] = frame[0] + (frame[2] - frame[0]) * frac;
+        dst[i * 2 + 1] = frame[1] + (frame[3] - frame[1]) * frac;
+        ts->rs_pos += pitch;
+    }
+}
+
+// leaving the stretcher: plays out whatever it already took from the ring (resampler leftovers, the rest of the current
+// hop, then the input it read ahead) at 1x, so nothing gets skipped. the input after the last segment's fade in picks
+// up exactly where the hop's overlap leaves off, so it goes out as is. returns the frames written, once that's less
+// than n_frames the stretcher is empty and inactive
+static int timestretch_drain(TimeStretch* ts, float* dst, const int n_frames) {
+    int n_out = 0;
+    while (n_out < n_frames && ts->rs_pos + 1.0 < ts->rs_frames) {
+        const int idx = (int)ts->rs_pos;
+        const float frac = (float)(ts->rs_pos - idx);
+        const float* frame = ts->rs_buf + idx * 2;
+        dst[n_out * 2] = frame[0] + (frame[2] - frame[0]) * frac;
+        dst[n_out * 2 + 1] = frame[1] + (frame[3] - frame[1]) * frac;
+        ts->rs_pos += 1.0;
+        n_out++;
+    }
+
+    const int cpy = SDL_min(n_frames - n_out, STRETCH_HOP_FRAMES - ts->out_pos);
+    SDL_memcpy(dst + n_out * 2, ts->out + ts->out_pos * 2, cpy * 2 * sizeof(float));
+    ts->out_pos += cpy;
+    n_out += cpy;
+
+    if (ts->out_pos == STRETCH_HOP_FRAMES && ts->have_prev) {
+        // move the unplayed input to the front, which leaves the stretcher in the same state as a fresh switch-in
+        // (so going back to stretching mid-drain is seamless too)
+        const int start = ts->prev_pos + STRETCH_HOP_FRAMES;
+        ts->in_frames -= start;
+        SDL_memmove(ts->in, ts->in + start * 2, ts->in_frames * 2 * sizeof(float));
+        ts->nominal_pos = 0.0;
+        ts->prev_pos = 0;
+        ts->have_prev = SDL_FALSE;
+    }
+    if (ts->out_pos == STRETCH_HOP_FRAMES) {
+        const int raw = SDL_min(n_frames - n_out, ts->in_frames);
+        SDL_memcpy(dst + n_out * 2, ts->in, raw * 2 * sizeof(float));
+        ts->in_frames -= raw;
+        SDL_memmove(ts->in, ts->in + raw * 2, ts->in_frames * 2 * sizeof(float));
+        n_out += raw;
+    }
+
+    if (n_out < n_frames) {
+        ts->active = SDL_FALSE;
+    }
+    return n_out;
+}
+
+#ifdef __SSE2__
+// one xorshift32 step per lane, returning uniform floats in [0, 1)
+static SDL_INLINE __m128 dither_uniform4(__m128i* seed) {
+    __m128i x = *seed;
+    x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+    x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+    *seed = x;
+    const __m128i mantissa = _mm_or_si128(_mm_srli_epi32(x, 9), _mm_set1_epi32(0x3F800000));
+    return _mm_sub_ps(_mm_castsi128_ps(mantissa), _mm_set1_ps(1.0f));
+}
+#endif
+
+static SDL_INLINE float dither_uniform(Uint32* seed) {
+    Uint32 x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *seed = x;
+    return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+// scales to full_scale, adds +/-1 LSB triangular (TPDF) dither, rounds and clamps. S24 goes out as the top 24 bits of
+// an S32 sample since SDL2 has no packed 24-bit format
+static void convert_dithered_s16(const float* src, Sint16* dst, const int n_samples, Uint32* dither_seed) {
+    const float full_scale = 32768.0f;
+    int i = 0;
+#ifdef __SSE2__
+    __m128i seed = _mm_loadu_si128((const __m128i*)dither_seed);
+    const __m128 scale = _mm_set1_ps(full_scale);
+    for (; i + 8 <= n_samples; i += 8) {
+        __m128 lo = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+        __m128 hi = _mm_mul_ps(_mm_loadu_ps(src + i + 4), scale);
+        lo = _mm_add_ps(lo, _mm_sub_ps(dither_uniform4(&seed), dither_uniform4(&seed)));
+        hi = _mm_add_ps(hi, _mm_sub_ps(dither_uniform4(&seed), dither_uniform4(&seed)));
+        // cvtps rounds to nearest, packs saturates to the S16 range
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi)));
+    }
+    _mm_storeu_si128((__m128i*)dither_seed, seed);
+#endif
+    for (; i < n_samples; i++) {
+        const float tpdf = dither_uniform(&dither_seed[0]) - dither_uniform(&dither_seed[0]);
+        const float val = SDL_floorf(src[i] * full_scale + tpdf + 0.5f);
+        dst[i] = (Sint16)SDL_clamp(val, -32768.0f, 32767.0f);
+    }
+}
+
+static void convert_dithered_s24(const float* src, Sint32* dst, const int n_samples, Uint32* dither_seed) {
+    const float full_scale = 8388608.0f;
+    int i = 0;
+#ifdef __SSE2__
+    __m128i seed = _mm_loadu_si128((const __m128i*)dither_seed);
+    const __m128 scale = _mm_set1_ps(full_scale);
+    const __m128 min_val = _mm_set1_ps(-8388608.0f);
+    const __m128 max_val = _mm_set1_ps(8388607.0f);
+    for (; i + 4 <= n_samples; i += 4) {
+        __m128 val = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+        val = _mm_add_ps(val, _mm_sub_ps(dither_uniform4(&seed), dither_uniform4(&seed)));
+        val = _mm_min_ps(_mm_max_ps(val, min_val), max_val);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_slli_epi32(_mm_cvtps_epi32(val), 8));
+    }
+    _mm_storeu_si128((__m128i*)dither_seed, seed);
+#endif
+    for (; i < n_samples; i++) {
+        const float tpdf = dither_uniform(&dither_seed[0]) - dither_uniform(&dither_seed[0]);
+        const float val = SDL_floorf(src[i] * full_scale + tpdf + 0.5f);
+        dst[i] = (Sint32)SDL_clamp(val, -8388608.0f, 8388607.0f) * 256;
+    }
+}
+
+static void mix_into(float* dst, const float* src, const int n_samples) {
+    int i = 0;
+#ifdef __SSE__
+    for (; i + 4 <= n_samples; i += 4) {
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_loadu_ps(src + i)));
+    }
+#endif
+    for (; i < n_samples; i++) {
+        dst[i] += src[i];
+    }
+}
+
+// audio thread: renders n_frames of the player's F32 stereo through its DSP chain. returns SDL_FALSE (and leaves
+// samples alone) if the player has nothing to say right now
+static SDL_bool render_player(Player* player, float* samples, const int n_frames) {
+    if (SDL_AtomicGet(&player->paused)) {
+        return SDL_FALSE;
+    }
+    // the stretcher may still hold input it read ahead, that has to be played before the file counts as over
+    const SDL_bool ring_done = (SDL_AtomicGet(&player->eof) && player_ring_fill(player) == 0) ? SDL_TRUE : SDL_FALSE;
+    if (ring_done && !player->stretch.active) {
+        return SDL_FALSE;
+    }
+
+    const float speed = atomic_get_float(&player->speed_target);
+    const float pitch = atomic_get_float(&player->pitch_target);
+    if (ring_done || (speed == 1.0f && pitch == 1.0f)) {
+        int n_drained = 0;
+        if (player->stretch.active) {
+            n_drained = timestretch_drain(&player->stretch, samples, n_frames);
         }
+        player_read_frames(player, samples + n_drained * 2, n_frames - n_drained);
     } else {
-        for (int btn_idx = BTN_WINAMP; btn_idx <= BTN_CLOSE; btn_idx++) {
-            const SDL_Rect dest_rect = skin.buttons[btn_idx].dest_rect;
-            if (SDL_PointInRect(area, &dest_rect)) {
-                return SDL_HITTEST_NORMAL;
+        if (!player->stretch.active) {
+            timestretch_reset(&player->stretch);
+        }
+        timestretch_render(&player->stretch, samples, n_frames, speed, pitch);
+    }
+
+    dsp_run_chain(dsp_acquire_chain(&player->chain), samples, n_frames);
+    return SDL_TRUE;
+}
+
+// mixes every player on this output into mix (zeroed first) and runs the bus chain. returns SDL_FALSE if nobody played
+static SDL_bool render_output(AudioOutput* output, float* mix, const int n_frames) {
+    SDL_bool any_playing = SDL_FALSE;
+    for (int i = 0; i < output->n_players; i++) {
+        // the first player that plays renders straight into the mix, the rest go through player_buf
+        float* dst = any_playing ? output->player_buf : mix;
+        if (render_player(output->players[i], dst, n_frames)) {
+            if (any_playing) {
+                mix_into(mix, dst, n_frames * 2);
             }
+            any_playing = SDL_TRUE;
+        }
+    }
+    if (any_playing) {
+        dsp_run_chain(dsp_acquire_chain(&output->chain), mix, n_frames);
+        output->idle = SDL_FALSE;
+    } else if (!output->idle) {
+        // the chain isn't run while nothing plays, so whatever its stages buffered (the limiter's lookahead) would
+        // otherwise come out in front of the next thing that plays
+        dsp_reset_chain(dsp_acquire_chain(&output->chain));
+        output->idle = SDL_TRUE;
+    }
+    return any_playing;
+}
+
+static void SDLCALL feed_audio_device_callback(void* userdata, Uint8* output_stream, int len) {
+    AudioOutput* output = (AudioOutput*)userdata;
+    const int frame_size = (SDL_AUDIO_BITSIZE(output->format) / 8) * 2;
+    int n_frames = len / frame_size;
+
+    while (n_frames > 0) {
+        const int chunk = SDL_min(n_frames, output->buf_frames);
+        float* mix = (output->format == AUDIO_F32) ? (float*)output_stream : output->mix_buf;
+        if (!render_output(output, mix, chunk)) {
+            SDL_memset(output_stream, '\0', chunk * frame_size);
+        } else if (output->format == AUDIO_S16SYS) {
+            convert_dithered_s16(mix, (Sint16*)output_stream, chunk * 2, output->dither_seed);
+        } else if (output->format == AUDIO_S32SYS) {
+            convert_dithered_s24(mix, (Sint32*)output_stream, chunk * 2, output->dither_seed);
         }
+        output_stream += chunk * frame_size;
+        n_frames -= chunk;
+    }
+}
+
+static SDL_INLINE WinampSkinMode cur_skin_mode(void) { return winshade_mode ? MODE_WINSHADE : MODE_NORMAL; }
+
+// constant time, whatever the layout: the widget id under pt in the current mode
+static SDL_INLINE Uint8 skin_hittest(const WinampSkin* skin, const SDL_Point* pt) {
+    if (pt->x < 0 || pt->y < 0 || pt->x >= SKIN_W || pt->y >= SKIN_H) {
+        return WIDGET_NONE;
+    }
+    return skin->hit_grid[cur_skin_mode()][pt->y * SKIN_W + pt->x];
+}
+
+static SDL_INLINE int scale_to_window(const int skin_px) { return (int)(skin_px * ui_scale + 0.5f); }
+
+// window coords (what mouse events and the hit test get) to skin coords. floors so that points left of/above the
+// window while the mouse is captured stay negative
+static SDL_INLINE SDL_Point window_to_skin(const int x, const int y) {
+    const SDL_Point pt = {(int)SDL_floorf(x / ui_scale), (int)SDL_floorf(y / ui_scale)};
+    return pt;
+}
+
+SDL_HitTestResult SDLCALL hittest_callback(SDL_Window* window, const SDL_Point* area, void* data) {
+    const SDL_Point pt = window_to_skin(area->x, area->y);
+    if (pt.y >= SKIN_WINSHADE_H) {
+        return SDL_HITTEST_NORMAL;
+    }
+
+    // anything in the titlebar that isn't a widget drags the window
+    if (skin_hittest(&skin, &pt) != WIDGET_NONE) {
+        return SDL_HITTEST_NORMAL;
     }
 
     return (skin.pressed_btn == NULL) ? SDL_HITTEST_DRAGGABLE : SDL_HITTEST_NORMAL;
@@ -237,9 +1337,52 @@ SDL_HitTestResult SDLCALL hittest_callback(SDL_Window* window, const SDL_Point*
 
 static void minimize_clickfn(void) { SDL_MinimizeWindow(window); }
 
+// swaps in the current mode's precomputed mask, nothing gets rasterized here
+// sdl parks a shaped window offscreen until its first shape is set, so this must always end up with the window on
+// screen: with no mask (out of memory) it's a full rectangle, and if that can't be set either it gets moved by hand
+static void apply_window_shape(WinampSkin* skin) {
+    static SDL_bool window_shaped = SDL_FALSE;
+    if (!SDL_IsShapedWindow(window)) {
+        return;
+    }
+
+    SDL_Surface* shape = skin->shape[cur_skin_mode()];
+    SDL_Surface* rect_shape = NULL;
+    if (shape == NULL) {
+        const int h = winshade_mode ? SKIN_WINSHADE_H : SKIN_H;
+        rect_shape = SDL_CreateRGBSurfaceWithFormat(
+                0, scale_to_window(SKIN_W), scale_to_window(h), 32, SDL_PIXELFORMAT_RGBA32);
+        if (rect_shape) {
+            SDL_FillRect(rect_shape, NULL, SDL_MapRGBA(rect_shape->format, 255, 255, 255, 255));
+        }
+        shape = rect_shape;
+    }
+
+    int rc = -1;
+    if (shape) {
+        SDL_WindowShapeMode shape_mode;
+        shape_mode.mode = ShapeModeBinarizeAlpha;
+        shape_mode.parameters.binarizationCutoff = 128;
+        rc = SDL_SetWindowShape(window, shape, &shape_mode);
+    }
+    if (rect_shape) {
+        SDL_FreeSurface(rect_shape);
+    }
+
+    if (rc == 0) {
+        window_shaped = SDL_TRUE;
+    } else {
+        SDL_Log("Couldn't set window shape (%d): %s", rc, SDL_GetError());
+        if (!window_shaped) {
+            SDL_SetWindowPosition(window, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED);
+        }
+    }
+}
+
 static void winshade_clickfn(void) {
     winshade_mode = (winshade_mode) ? SDL_FALSE : SDL_TRUE;
-    SDL_SetWindowSize(window, 275, (winshade_mode ? 14 : 116));
+    SDL_SetWindowSize(window, scale_to_window(SKIN_W), scale_to_window(winshade_mode ? SKIN_WINSHADE_H : SKIN_H));
+    apply_window_shape(&skin);
 }
 
 static void close_clickfn(void) {
@@ -250,25 +1393,35 @@ static void close_clickfn(void) {
 }
 
 static void prev_clickfn(void) {
+    Player* player = ui_player;
     int rc = 1;
-    SDL_LockAudioDevice(audio_device);
-    if (cur_sample) {
-        rc = Sound_Rewind(cur_sample);
+    SDL_LockMutex(player->decode_lock);
+    if (player->sample) {
+        rc = Sound_Rewind(player->sample);
     }
-    available_samples = 0;
-    sample_pos = 0;
-    SDL_UnlockAudioDevice(audio_device);
+    player->available_samples = 0;
+    player->sample_pos = 0;
+    player_flush(player);
+    SDL_UnlockMutex(player->decode_lock);
+    SDL_SemPost(decode_wakeup);
     if (!rc) {
         SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "couldn't rewind audio file", Sound_GetError(), window);
     }
 }
 
-static void pause_clickfn(void) {
-    paused = paused ? SDL_FALSE : SDL_TRUE;
-    SDL_PauseAudioDevice(audio_device, paused);
+static void set_speed(Player* player, const float speed) {
+    const float clamped = SDL_clamp(speed, 0.5f, 2.0f);
+    atomic_set_float(&player->speed_target, SDL_roundf(clamped * 10.0f) / 10.0f);
+}
+
+static void set_pitch_semitones(Player* player, const int semitones) {
+    player->pitch_semitones = SDL_clamp(semitones, -12, 12);
+    atomic_set_float(&player->pitch_target, SDL_powf(2.0f, player->pitch_semitones / 12.0f));
 }
 
-static void stop_clickfn(void) { stop_audio(); }
+static void pause_clickfn(void) { SDL_AtomicSet(&ui_player->paused, SDL_AtomicGet(&ui_player->paused) ? 0 : 1); }
+
+static void stop_clickfn(void) { stop_audio(ui_player); }
 
 // inlined funtion?
 static SDL_INLINE void init_skin_btn(
@@ -346,13 +1499,279 @@ static void free_skin(WinampSkin* skin) {
     if (skin->tex_titlebar) {
         SDL_DestroyTexture(skin->tex_balance);
     }
+    for (int mode = 0; mode < MODE_TOTAL; mode++) {
+        if (skin->shape[mode]) {
+            SDL_FreeSurface(skin->shape[mode]);
+        }
+    }
     SDL_zerop(skin);  // zerop lets you pass in pointer instead of dereferenced ptr
 }
 
+// hands the current slider values to the audio callback, never blocks on the audio device
+static void publish_audio_params(WinampSkin* skin) {
+    if (ui_player == NULL) {
+        return;
+    }
+    ui_player->volume = skin->sliders[SLD_VOLUME].val;
+    ui_player->balance = skin->sliders[SLD_BALANCE].val;
+    atomic_set_float(&ui_player->volume_target, ui_player->volume);
+    atomic_set_float(&ui_player->balance_target, ui_player->balance);
+}
+
+static void set_slider_val(WinampSkinSlider* slider, const float val) {
+    slider->val = val;
+    const int knob_dest_x = slider->dest_rect.x + (int)(val * slider->dest_rect.w) - (slider->knob.dest_rect.w / 2);
+    const int min_knob_dest_x = slider->dest_rect.x;
+    const int max_knob_dest_x = slider->dest_rect.x + slider->dest_rect.w - slider->knob.dest_rect.w;
+    slider->knob.dest_rect.x = SDL_clamp(knob_dest_x, min_knob_dest_x, max_knob_dest_x);
+}
+
+// points the sliders at whatever the player is currently set to, e.g. after switching players or reloading the skin
+static void show_player_on_skin(WinampSkin* skin, Player* player) {
+    if (player == NULL) {
+        return;
+    }
+    set_slider_val(&skin->sliders[SLD_VOLUME], player->volume);
+    set_slider_val(&skin->sliders[SLD_BALANCE], player->balance);
+}
+
+static const WinampSkinBtnLayout normal_btn_layout[BTN_TOTAL] = {
+        [BTN_WINAMP] = {TEX_TITLEBAR, NULL, {0, 0, 9, 9}, {0, 9, 9, 9}, {6, 3, 9, 9}},
+        [BTN_MINIMIZE] = {TEX_TITLEBAR, &minimize_clickfn, {9, 0, 9, 9}, {9, 9, 9, 9}, {244, 3, 9, 9}},
+        [BTN_WINSHADE] = {TEX_TITLEBAR, &winshade_clickfn, {0, 18, 9, 9}, {9, 18, 9, 9}, {254, 3, 9, 9}},
+        [BTN_CLOSE] = {TEX_TITLEBAR, &close_clickfn, {18, 0, 9, 9}, {18, 9, 9, 9}, {264, 3, 9, 9}},
+        [BTN_PREV] = {TEX_CBUTTONS, NULL, {0, 0, 23, 18}, {0, 18, 23, 18}, {16, 88, 23, 18}},
+        [BTN_PLAY] = {TEX_CBUTTONS, &prev_clickfn, {23, 0, 23, 18}, {23, 18, 23, 18}, {39, 88, 23, 18}},
+        [BTN_PAUSE] = {TEX_CBUTTONS, &pause_clickfn, {46, 0, 23, 18}, {46, 18, 23, 18}, {62, 88, 23, 18}},
+        [BTN_STOP] = {TEX_CBUTTONS, &stop_clickfn, {69, 0, 23, 18}, {69, 18, 23, 18}, {85, 88, 23, 18}},
+        [BTN_NEXT] = {TEX_CBUTTONS, NULL, {92, 0, 22, 18}, {92, 18, 22, 18}, {108, 88, 22, 18}},
+        [BTN_EJECT] = {TEX_CBUTTONS, NULL, {114, 0, 22, 16}, {114, 16, 22, 16}, {136, 89, 22, 16}},
+};
+
+static const WinampSkinSliderLayout normal_slider_layout[SLD_TOTAL] = {
+        // volume level starts at 1.0
+        [SLD_VOLUME] = {TEX_VOLUME, {0, 422, 14, 11}, {15, 422, 14, 11}, 0, 0, 28, 68, 15, {107, 57, 68, 13}, 1.0f},
+        // balance level starts at 0.5
+        [SLD_BALANCE] = {TEX_BALANCE, {0, 422, 14, 11}, {15, 422, 14, 11}, 9, 0, 28, 38, 15, {177, 57, 38, 13}, 0.5f},
+};
+
+// in winshade mode the transport buttons are invisible hotspots on the titlebar bitmap
+static const WinampSkinBtnLayout winshade_btn_layout[BTN_TOTAL] = {
+        [BTN_WINAMP] = {TEX_TITLEBAR, NULL, {0, 0, 9, 9}, {0, 9, 9, 9}, {6, 3, 9, 9}},
+        [BTN_MINIMIZE] = {TEX_TITLEBAR, &minimize_clickfn, {9, 0, 9, 9}, {9, 9, 9, 9}, {244, 3, 9, 9}},
+        [BTN_WINSHADE] = {TEX_TITLEBAR, &winshade_clickfn, {0, 27, 9, 9}, {9, 27, 9, 9}, {254, 3, 9, 9}},
+        [BTN_CLOSE] = {TEX_TITLEBAR, &close_clickfn, {18, 0, 9, 9}, {18, 9, 9, 9}, {264, 3, 9, 9}},
+        [BTN_PREV] = {TEX_TITLEBAR, &prev_clickfn, {0, 0, 0, 0}, {0, 0, 0, 0}, {168, 2, 8, 10}},
+        [BTN_PLAY] = {TEX_TITLEBAR, NULL, {0, 0, 0, 0}, {0, 0, 0, 0}, {176, 2, 10, 10}},
+        [BTN_PAUSE] = {TEX_TITLEBAR, &pause_clickfn, {0, 0, 0, 0}, {0, 0, 0, 0}, {186, 2, 9, 10}},
+        [BTN_STOP] = {TEX_TITLEBAR, &stop_clickfn, {0, 0, 0, 0}, {0, 0, 0, 0}, {195, 2, 9, 10}},
+        [BTN_NEXT] = {TEX_TITLEBAR, NULL, {0, 0, 0, 0}, {0, 0, 0, 0}, {204, 2, 11, 10}},
+        [BTN_EJECT] = {TEX_TITLEBAR, NULL, {0, 0, 0, 0}, {0, 0, 0, 0}, {215, 2, 10, 10}},
+};
+
+static const WinampSkinSliderLayout winshade_slider_layout[] = {
+        // pos slider starts at 0.0
+        {TEX_TITLEBAR, {17, 36, 3, 7}, {17, 36, 3, 7}, 0, 36, 1, 17, 7, {226, 4, 17, 7}, 0.0f},
+};
+
+static const WinampSkinLayout skin_layouts[MODE_TOTAL] = {
+        [MODE_NORMAL]
+        = {normal_btn_layout, BTN_TOTAL, normal_slider_layout, SLD_TOTAL, SKIN_H},
+        [MODE_WINSHADE]
+        = {winshade_btn_layout, BTN_TOTAL, winshade_slider_layout, SDL_arraysize(winshade_slider_layout), SKIN_WINSHADE_H},
+};
+
+static SDL_Texture* skin_texture(WinampSkin* skin, const WinampSkinTexID tex) {
+    switch (tex) {
+        case TEX_MAIN: return skin->tex_main;
+        case TEX_CBUTTONS: return skin->tex_cbuttons;
+        case TEX_VOLUME: return skin->tex_volume;
+        case TEX_BALANCE: return skin->tex_balance;
+        case TEX_TITLEBAR: return skin->tex_titlebar;
+    }
+    return NULL;
+}
+
+static void rasterize_widget(WinampSkin* skin, const WinampSkinMode mode, const SDL_Rect* rect, const Uint8 id) {
+    const int h = skin_layouts[mode].h;
+    const int x0 = SDL_max(rect->x, 0);
+    const int y0 = SDL_max(rect->y, 0);
+    const int x1 = SDL_min(rect->x + rect->w, SKIN_W);
+    const int y1 = SDL_min(rect->y + rect->h, h);
+    for (int y = y0; y < y1; y++) {
+        if (x1 > x0) {
+            SDL_memset(&skin->hit_grid[mode][y * SKIN_W + x0], id, x1 - x0);
+        }
+    }
+}
+
+// builds a mode's buttons/sliders from its layout table and bakes them into the hit grid. later widgets win where
+// they overlap, so a slider beats a button under it just like the old linear scans did
+static void compile_skin_layout(WinampSkin* skin, const WinampSkinMode mode) {
+    const WinampSkinLayout* layout = &skin_layouts[mode];
+    WinampSkinBtn* buttons = (mode == MODE_WINSHADE) ? skin->winshade_buttons : skin->buttons;
+    WinampSkinSlider* sliders = (mode == MODE_WINSHADE) ? &skin->winshade_slider : skin->sliders;
+    Uint8 id = WIDGET_NONE + 1;
+
+    SDL_zeroa(skin->hit_grid[mode]);
+    SDL_zeroa(skin->widgets[mode]);
+
+    for (int i = 0; i < layout->n_buttons; i++, id++) {
+        const WinampSkinBtnLayout* btn = &layout->buttons[i];
+        init_skin_btn(
+                &buttons[i],
+                skin_texture(skin, btn->tex),
+                btn->clickfn,
+                btn->src_unpressed_rect,
+                btn->src_pressed_rect,
+                btn->dest_rect);
+        skin->widgets[mode][id].btn = &buttons[i];
+        rasterize_widget(skin, mode, &btn->dest_rect, id);
+    }
+
+    for (int i = 0; i < layout->n_sliders; i++, id++) {
+        const WinampSkinSliderLayout* sld = &layout->sliders[i];
+        init_skin_slider(
+                &sliders[i],
+                skin_texture(skin, sld->tex),
+                sld->knob_src_unpressed_rect,
+                sld->knob_src_pressed_rect,
+                sld->frame_x_offset,
+                sld->frame_y_offset,
+                sld->n_frames,
+                sld->frame_width,
+                sld->frame_height,
+                sld->dest_rect,
+                sld->val);
+        skin->widgets[mode][id].btn = &sliders[i].knob;
+        skin->widgets[mode][id].slider = &sliders[i];
+        rasterize_widget(skin, mode, &sld->dest_rect, id);
+    }
+}
+
+// reads a comma separated list of ints into vals, skipping empty entries (real skins have things like "272,0, ,275,3")
+static int parse_int_list(const char* str, int* vals, const int max_vals) {
+    int n = 0;
+    while (*str && n < max_vals) {
+        char* end = NULL;
+        const long val = SDL_strtol(str, &end, 10);
+        if (end == str) {
+            str++;  // comma, whitespace or junk
+            continue;
+        }
+        vals[n++] = (int)val;
+        str = end;
+    }
+    return n;
+}
+
+// region.txt is an ini file, we only care about the [Normal] and [WindowShade] sections. like windows' profile apis,
+// the first NumPoints/PointList in a section wins, so commented out section headers don't override anything
+static void parse_region_txt(char* text, WinampSkinRegion* regions) {
+    WinampSkinRegion* region = NULL;
+    char* saveptr = NULL;
+    for (char* line = SDL_strtokr(text, "\r\n", &saveptr); line; line = SDL_strtokr(NULL, "\r\n", &saveptr)) {
+        while (SDL_isspace(*line)) {
+            line++;
+        }
+        if (*line == '[') {
+            region = NULL;
+            if (SDL_strncasecmp(line, "[Normal]", 8) == 0) {
+                region = &regions[MODE_NORMAL];
+            } else if (SDL_strncasecmp(line, "[WindowShade]", 13) == 0) {
+                region = &regions[MODE_WINSHADE];
+            }
+            continue;
+        }
+
+        const char* value = SDL_strchr(line, '=');
+        if (region == NULL || value == NULL) {
+            continue;
+        }
+        value++;
+        if (SDL_strncasecmp(line, "NumPoints", 9) == 0 && region->n_polys == 0) {
+            region->n_polys = parse_int_list(value, region->n_points, REGION_MAX_POLYS);
+        } else if (SDL_strncasecmp(line, "PointList", 9) == 0 && region->n_coords == 0) {
+            region->n_coords = parse_int_list(value, region->coords, REGION_MAX_POINTS * 2) & ~1;
+        }
+    }
+}
+
+// even-odd rule, same as windows' ALTERNATE fill mode that winamp builds its regions with
+static SDL_bool point_in_polygon(const int* coords, const int n_points, const float x, const float y) {
+    SDL_bool inside = SDL_FALSE;
+    for (int i = 0, j = n_points - 1; i < n_points; j = i++) {
+        const float xi = (float)coords[i * 2], yi = (float)coords[i * 2 + 1];
+        const float xj = (float)coords[j * 2], yj = (float)coords[j * 2 + 1];
+        if (((yi > y) != (yj > y)) && (x < (xj - xi) * (y - yi) / (yj - yi) + xi)) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+// pixels covered by any of the region's polygons (sampled at pixel centers) become opaque. a missing or empty region
+// is a plain rectangle. w/h are in skin pixels, the mask itself is window sized so it follows ui_scale
+static SDL_Surface* rasterize_region(const WinampSkinRegion* region, const int w, const int h) {
+    SDL_Surface* mask
+            = SDL_CreateRGBSurfaceWithFormat(0, scale_to_window(w), scale_to_window(h), 32, SDL_PIXELFORMAT_RGBA32);
+    if (!mask) {
+        return NULL;
+    }
+    const Uint32 opaque = SDL_MapRGBA(mask->format, 255, 255, 255, 255);
+    const Uint32 clear = SDL_MapRGBA(mask->format, 0, 0, 0, 0);
+
+    // drop polygons that PointList doesn't have enough points for
+    int n_polys = 0;
+    int n_used = 0;
+    for (; n_polys < region->n_polys; n_polys++) {
+        if (region->n_points[n_polys] < 0 || n_used + region->n_points[n_polys] > region->n_coords / 2) {
+            break;
+        }
+        n_used += region->n_points[n_polys];
+    }
+
+    for (int y = 0; y < mask->h; y++) {
+        Uint32* row = (Uint32*)((Uint8*)mask->pixels + y * mask->pitch);
+        for (int x = 0; x < mask->w; x++) {
+            SDL_bool covered = (n_used == 0) ? SDL_TRUE : SDL_FALSE;
+            const int* coords = region->coords;
+            for (int i = 0; i < n_polys && !covered; i++) {
+                if (region->n_points[i] >= 3) {
+                    const float px = (x + 0.5f) / ui_scale;
+                    const float py = (y + 0.5f) / ui_scale;
+                    covered = point_in_polygon(coords, region->n_points[i], px, py);
+                }
+                coords += region->n_points[i] * 2;
+            }
+            row[x] = covered ? opaque : clear;
+        }
+    }
+    return mask;
+}
+
+// rw may be NULL (skin has no region.txt), in which case both modes get rectangular masks
+static void load_skin_shapes(WinampSkin* skin, SDL_RWops* rw) {
+    static WinampSkinRegion regions[MODE_TOTAL];  // big-ish, keep it off the stack
+    SDL_zeroa(regions);
+    if (rw) {
+        char* text = (char*)SDL_LoadFile_RW(rw, NULL, 1);  // always null terminated
+        if (text) {
+            parse_region_txt(text, regions);
+            SDL_free(text);
+        }
+    }
+    skin->shape[MODE_NORMAL] = rasterize_region(&regions[MODE_NORMAL], SKIN_W, SKIN_H);
+    skin->shape[MODE_WINSHADE] = rasterize_region(&regions[MODE_WINSHADE], SKIN_W, SKIN_WINSHADE_H);
+    apply_window_shape(skin);
+}
+
 static void load_skin(WinampSkin* skin, const char* __attribute__((unused)) fname) {
 
     free_skin(skin);
     if (!PHYSFS_mount(fname, NULL, 1)) {
+        load_skin_shapes(skin, NULL);
+        show_player_on_skin(skin, ui_player);
         return;  // ok if can't load from file
     }
 
@@ -361,198 +1780,310 @@ static void load_skin(WinampSkin* skin, const char* __attribute__((unused)) fnam
     skin->tex_volume = load_texture(open_rw("Volume.bmp"));
     skin->tex_balance = load_texture(open_rw("Balance.bmp"));
     skin->tex_titlebar = load_texture(open_rw("Titlebar.bmp"));
+    load_skin_shapes(skin, open_rw("region.txt"));
 
     PHYSFS_unmount(fname);
 
     skin->pressed_btn = NULL;
 
-    // non winshade mode buttons/sliders
-    init_skin_btn(
-            &skin->buttons[BTN_WINAMP],
-            skin->tex_titlebar,
-            NULL,
-            (SDL_Rect){0, 0, 9, 9},
-            (SDL_Rect){0, 9, 9, 9},
-            (SDL_Rect){6, 3, 9, 9});
-    init_skin_btn(
-            &skin->buttons[BTN_MINIMIZE],
-            skin->tex_titlebar,
-            &minimize_clickfn,
-            (SDL_Rect){9, 0, 9, 9},
-            (SDL_Rect){9, 9, 9, 9},
-            (SDL_Rect){244, 3, 9, 9});
-
-    init_skin_btn(
-            &skin->buttons[BTN_WINSHADE],
-            skin->tex_titlebar,
-            &winshade_clickfn,
-            (SDL_Rect){0, 18, 9, 9},
-            (SDL_Rect){9, 18, 9, 9},
-            (SDL_Rect){254, 3, 9, 9});
-    init_skin_btn(
-            &skin->buttons[BTN_CLOSE],
-            skin->tex_titlebar,
-            &close_clickfn,
-            (SDL_Rect){18, 0, 9, 9},
-            (SDL_Rect){18, 9, 9, 9},
-            (SDL_Rect){264, 3, 9, 9});
-    init_skin_btn(
-            &(skin->buttons[BTN_PREV]),
-            skin->tex_cbuttons,
-            NULL,
-            (SDL_Rect){0, 0, 23, 18},
-            (SDL_Rect){0, 18, 23, 18},
-            (SDL_Rect){16, 88, 23, 18});
-    init_skin_btn(
-            &(skin->buttons[BTN_PLAY]),
-            skin->tex_cbuttons,
-            &prev_clickfn,
-            (SDL_Rect){23, 0, 23, 18},
-            (SDL_Rect){23, 18, 23, 18},
-            (SDL_Rect){39, 88, 23, 18});
-    init_skin_btn(
-            &(skin->buttons[BTN_PAUSE]),
-            skin->tex_cbuttons,
-            &pause_clickfn,
-            (SDL_Rect){46, 0, 23, 18},
-            (SDL_Rect){46, 18, 23, 18},
-            (SDL_Rect){62, 88, 23, 18});
-    init_skin_btn(
-            &(skin->buttons[BTN_STOP]),
-            skin->tex_cbuttons,
-            &stop_clickfn,
-            (SDL_Rect){69, 0, 23, 18},
-            (SDL_Rect){69, 18, 23, 18},
-            (SDL_Rect){85, 88, 23, 18});
-    init_skin_btn(
-            &(skin->buttons[BTN_NEXT]),
-            skin->tex_cbuttons,
-            NULL,
-            (SDL_Rect){92, 0, 22, 18},
-            (SDL_Rect){92, 18, 22, 18},
-            (SDL_Rect){108, 88, 22, 18});
-    init_skin_btn(
-            &(skin->buttons[BTN_EJECT]),
-            skin->tex_cbuttons,
-            NULL,
-            (SDL_Rect){114, 0, 22, 16},
-            (SDL_Rect){114, 16, 22, 16},
-            (SDL_Rect){136, 89, 22, 16});
-
-    init_skin_slider(
-            &skin->sliders[SLD_VOLUME],
-            skin->tex_volume,
-            (SDL_Rect){0, 422, 14, 11},
-            (SDL_Rect){15, 422, 14, 11},
-            0,
-            0,
-            28,
-            68,
-            15,
-            (SDL_Rect){107, 57, 68, 13},
-            1.0f);  // volume level starts at 1.0
-
-    init_skin_slider(
-            &skin->sliders[SLD_BALANCE],
-            skin->tex_balance,
-            (SDL_Rect){0, 422, 14, 11},
-            (SDL_Rect){15, 422, 14, 11},
-            9,   // x offset
-            0,   // y offset
-            28,  // n frames
-            38,  // frame width
-            15,  // frame height
-            (SDL_Rect){177, 57, 38, 13},
-            0.5f);  // balance level starts at 0.5
-
-    // winshade mode buttons/slider
-    init_skin_btn(
-            &skin->winshade_buttons[BTN_WINAMP],
-            skin->tex_titlebar,
-            NULL,
-            (SDL_Rect){0, 0, 9, 9},
-            (SDL_Rect){0, 9, 9, 9},
-            (SDL_Rect){6, 3, 9, 9});
-    init_skin_btn(
-            &skin->winshade_buttons[BTN_MINIMIZE],
-            skin->tex_titlebar,
-            &minimize_clickfn,
-            (SDL_Rect){9, 0, 9, 9},
-            (SDL_Rect){9, 9, 9, 9},
-            (SDL_Rect){244, 3, 9, 9});
-
-    init_skin_btn(
-            &skin->winshade_buttons[BTN_WINSHADE],
-            skin->tex_titlebar,
-            &winshade_clickfn,
-            (SDL_Rect){0, 27, 9, 9},
-            (SDL_Rect){9, 27, 9, 9},
-            (SDL_Rect){254, 3, 9, 9});
-    init_skin_btn(
-            &skin->winshade_buttons[BTN_CLOSE],
-            skin->tex_titlebar,
-            &close_clickfn,
-            (SDL_Rect){18, 0, 9, 9},
-            (SDL_Rect){18, 9, 9, 9},
-            (SDL_Rect){264, 3, 9, 9});
-    init_skin_btn(
-            &(skin->winshade_buttons[BTN_PREV]),
-            skin->tex_titlebar,
-            &prev_clickfn,
-            (SDL_Rect){0, 0, 0, 0},
-            (SDL_Rect){0, 0, 0, 0},
-            (SDL_Rect){168, 2, 8, 10});
-    init_skin_btn(
-            &(skin->winshade_buttons[BTN_PLAY]),
-            skin->tex_titlebar,
-            NULL,
-            (SDL_Rect){0, 0, 0, 0},
-            (SDL_Rect){0, 0, 0, 0},
-            (SDL_Rect){176, 2, 10, 10});
-    init_skin_btn(
-            &(skin->winshade_buttons[BTN_PAUSE]),
-            skin->tex_titlebar,
-            &pause_clickfn,
-            (SDL_Rect){0, 0, 0, 0},
-            (SDL_Rect){0, 0, 0, 0},
-            (SDL_Rect){186, 2, 9, 10});
-    init_skin_btn(
-            &(skin->winshade_buttons[BTN_STOP]),
-            skin->tex_titlebar,
-            &stop_clickfn,
-            (SDL_Rect){0, 0, 0, 0},
-            (SDL_Rect){0, 0, 0, 0},
-            (SDL_Rect){195, 2, 9, 10});
-    init_skin_btn(
-            &(skin->winshade_buttons[BTN_NEXT]),
-            skin->tex_titlebar,
-            NULL,
-            (SDL_Rect){0, 0, 0, 0},
-            (SDL_Rect){0, 0, 0, 0},
-            (SDL_Rect){204, 2, 11, 10});
-    init_skin_btn(
-            &(skin->winshade_buttons[BTN_EJECT]),
-            skin->tex_titlebar,
-            NULL,
-            (SDL_Rect){0, 0, 0, 0},
-            (SDL_Rect){0, 0, 0, 0},
-            (SDL_Rect){215, 2, 10, 10});
-
-    init_skin_slider(
-            &skin->winshade_slider,
-            skin->tex_titlebar,
-            (SDL_Rect){17, 36, 3, 7},
-            (SDL_Rect){17, 36, 3, 7},
-            0,
-            36,
-            1,
-            17,
-            7,
-            (SDL_Rect){226, 4, 17, 7},
-            0.0f);  // pos slider starts at 0.0
+    for (int mode = 0; mode < MODE_TOTAL; mode++) {
+        compile_skin_layout(skin, (WinampSkinMode)mode);
+    }
+
+    show_player_on_skin(skin, ui_player);
+}
+
+// opens (or reuses) the device players get routed to. device_name NULL is the system default
+static AudioOutput* get_output(const char* device_name) {
+    for (int i = 0; i < n_outputs; i++) {
+        const char* name = outputs[i]->device_name;
+        if ((name == NULL && device_name == NULL) || (name && device_name && SDL_strcmp(name, device_name) == 0)) {
+            return outputs[i];
+        }
+    }
+    if (n_outputs == MAX_OUTPUTS) {
+        panic_and_abort("Couldn't open audio device", "too many outputs");
+    }
+
+    AudioOutput* output = (AudioOutput*)SDL_calloc(1, sizeof(AudioOutput));
+    if (!output) {
+        panic_and_abort("Couldn't allocate audio output", "out of memory");
+    }
+    output->device_name = device_name;
+    SDL_AudioSpec spec = desired;
+    spec.userdata = output;
+
+    // only let SDL change the format, every other part of the spec HAS to match desired so SDL "fakes" it for us
+    SDL_AudioSpec obtained;
+    output->device = SDL_OpenAudioDevice(device_name, 0, &spec, &obtained, SDL_AUDIO_ALLOW_FORMAT_CHANGE);
+    if (output->device != 0 && obtained.format != AUDIO_F32 && obtained.format != AUDIO_S16SYS
+        && obtained.format != AUDIO_S32SYS) {
+        // some format we don't render natively, let SDL convert from F32 after all
+        SDL_CloseAudioDevice(output->device);
+        spec.format = AUDIO_F32;
+        output->device = SDL_OpenAudioDevice(device_name, 0, &spec, &obtained, 0);
+    }
+    if (output->device == 0) {
+        panic_and_abort("Couldn't open audio device", SDL_GetError());
+    }
+
+    output->format = obtained.format;
+    output->buf_frames = obtained.samples;
+    if (output->format != AUDIO_F32) {
+        output->mix_buf = (float*)SDL_malloc(output->buf_frames * 2 * sizeof(float));
+    }
+    output->player_buf = (float*)SDL_malloc(output->buf_frames * 2 * sizeof(float));
+    if ((output->format != AUDIO_F32 && !output->mix_buf) || !output->player_buf) {
+        panic_and_abort("Couldn't allocate mix buffer", "out of memory");
+    }
+    const Uint32 seeds[4] = {0x9E3779B9, 0x7F4A7C15, 0x2545F491, 0x6C078965};
+    for (int i = 0; i < 4; i++) {
+        output->dither_seed[i] = seeds[i] ^ (Uint32)(n_outputs * 0x01000193);
+    }
+    init_output_dsp(output, obtained.freq);
+
+    outputs[n_outputs++] = output;
+    return output;
+}
+
+static Player* create_player(AudioOutput* output) {
+    if (n_players == MAX_PLAYERS) {
+        panic_and_abort("Couldn't create player", "too many players");
+    }
+
+    Player* player = (Player*)SDL_calloc(1, sizeof(Player));
+    if (!player) {
+        panic_and_abort("Couldn't allocate player", "out of memory");
+    }
+    player->decode_lock = SDL_CreateMutex();
+    player->ring = (float*)SDL_malloc(PLAYER_RING_FRAMES * 2 * sizeof(float));
+    if (!player->decode_lock || !player->ring) {
+        panic_and_abort("Couldn't create player", SDL_GetError());
+    }
+    player->output = output;
+
+    SDL_AtomicSet(&player->eof, 1);
+    SDL_AtomicSet(&player->paused, 1);
+    player->volume = 1.0f;  // volume level starts at 1.0
+    player->balance = 0.5f;  // balance level starts at 0.5
+    atomic_set_float(&player->volume_target, player->volume);
+    atomic_set_float(&player->balance_target, player->balance);
+    set_speed(player, 1.0f);
+    set_pitch_semitones(player, 0);
+    init_timestretch(&player->stretch, player_read_frames, player);
+    init_player_dsp(player);
+
+    SDL_LockAudioDevice(output->device);
+    output->players[output->n_players++] = player;
+    SDL_UnlockAudioDevice(output->device);
+
+    players[n_players++] = player;
+    return player;
+}
+
+static void free_player(Player* player) {
+    dsp_free_chains(&player->chain);
+    if (player->sample) {
+        Sound_FreeSample(player->sample);
+    }
+    SDL_DestroyMutex(player->decode_lock);
+    SDL_free(player->ring);
+    SDL_free(player);
+}
+
+// SDL_DROPFILE/SDL_DROPTEXT carry a string that has to go in the file, not the pointer
+static SDL_bool event_has_drop_string(const SDL_Event* e) {
+    return ((e->type == SDL_DROPFILE || e->type == SDL_DROPTEXT) && e->drop.file) ? SDL_TRUE : SDL_FALSE;
+}
+
+static void open_input_tape(InputTape* tape) {
+    SDL_zerop(tape);
+
+    const char* record_fname = SDL_getenv("SDLAMP_RECORD");
+    if (record_fname) {
+        tape->record = SDL_RWFromFile(record_fname, "wb");
+        if (!tape->record) {
+            panic_and_abort("Couldn't open input recording", SDL_GetError());
+        }
+        SDL_RWwrite(tape->record, INPUT_TAPE_MAGIC, 8, 1);
+        SDL_WriteLE32(tape->record, INPUT_TAPE_VERSION);
+        SDL_WriteLE32(tape->record, (Uint32)sizeof(SDL_Event));
+        tape->record_start_ticks = SDL_GetTicks();
+    }
+
+    const char* replay_fname = SDL_getenv("SDLAMP_REPLAY");
+    if (replay_fname) {
+        char magic[8];
+        tape->replay = SDL_RWFromFile(replay_fname, "rb");
+        if (!tape->replay) {
+            panic_and_abort("Couldn't open input recording", SDL_GetError());
+        }
+        // the events are raw SDL_Event structs, so recordings only replay on builds with the same layout
+        if (SDL_RWread(tape->replay, magic, 8, 1) != 1 || SDL_memcmp(magic, INPUT_TAPE_MAGIC, 8) != 0
+            || SDL_ReadLE32(tape->replay) != INPUT_TAPE_VERSION || SDL_ReadLE32(tape->replay) != sizeof(SDL_Event)) {
+            panic_and_abort("Couldn't replay input recording", "not a recording from this build");
+        }
+        const char* step_hint = SDL_getenv("SDLAMP_REPLAY_STEP_MS");
+        tape->replay_step_ms = step_hint ? (Uint32)SDL_max(SDL_atoi(step_hint), 1) : 16;
+    }
+}
+
+static void close_input_tape(InputTape* tape) {
+    if (tape->record) {
+        SDL_RWclose(tape->record);
+    }
+    if (tape->replay) {
+        SDL_RWclose(tape->replay);
+    }
+    if (tape->have_pending && event_has_drop_string(&tape->pending)) {
+        SDL_free(tape->pending.drop.file);
+    }
+    SDL_zerop(tape);
+}
+
+static void record_input_event(InputTape* tape, const SDL_Event* e) {
+    SDL_WriteLE32(tape->record, SDL_GetTicks() - tape->record_start_ticks);
+    SDL_RWwrite(tape->record, e, sizeof(*e), 1);
+    if (event_has_drop_string(e)) {
+        const Uint32 len = (Uint32)SDL_strlen(e->drop.file);
+        SDL_WriteLE32(tape->record, len);
+        SDL_RWwrite(tape->record, e->drop.file, len, 1);
+    }
+}
+
+// reads the next recorded event into tape->pending. a short read ends the replay
+static SDL_bool read_input_event(InputTape* tape) {
+    Uint8 ms_bytes[4];
+    if (SDL_RWread(tape->replay, ms_bytes, 4, 1) != 1) {
+        return SDL_FALSE;
+    }
+    tape->pending_ms = (Uint32)ms_bytes[0] | ((Uint32)ms_bytes[1] << 8) | ((Uint32)ms_bytes[2] << 16)
+                       | ((Uint32)ms_bytes[3] << 24);
+    if (SDL_RWread(tape->replay, &tape->pending, sizeof(tape->pending), 1) != 1) {
+        return SDL_FALSE;
+    }
+    if (event_has_drop_string(&tape->pending)) {
+        const Uint32 len = SDL_ReadLE32(tape->replay);
+        char* str = (char*)SDL_malloc(len + 1);
+        if (!str || (len && SDL_RWread(tape->replay, str, len, 1) != 1)) {
+            SDL_free(str);
+            return SDL_FALSE;
+        }
+        str[len] = '\0';
+        tape->pending.drop.file = str;  // handle_events SDL_free()s it like one of sdl's own
+    }
+    tape->pending.common.timestamp = tape->pending_ms;
+    return SDL_TRUE;
+}
+
+// called once per handle_events. when replaying, real input is thrown away and the fixed clock moves on a frame
+static void begin_input_frame(InputTape* tape) {
+    if (tape->replay) {
+        SDL_PumpEvents();
+        SDL_FlushEvents(SDL_FIRSTEVENT, SDL_LASTEVENT);
+        tape->replay_clock += tape->replay_step_ms;
+    }
+}
+
+// SDL_PollEvent, but recorded or replayed as asked for
+static SDL_bool poll_input_event(InputTape* tape, SDL_Event* e) {
+    if (tape->replay == NULL) {
+        if (!SDL_PollEvent(e)) {
+            return SDL_FALSE;
+        }
+        if (tape->record) {
+            record_input_event(tape, e);
+        }
+        return SDL_TRUE;
+    }
+
+    if (tape->replay_done) {
+        return SDL_FALSE;
+    }
+    if (!tape->have_pending) {
+        tape->have_pending = read_input_event(tape);
+        if (!tape->have_pending) {
+            // recordings that end without the window being closed still quit
+            tape->replay_done = SDL_TRUE;
+            SDL_zerop(e);
+            e->type = SDL_QUIT;
+            return SDL_TRUE;
+        }
+    }
+    if (tape->pending_ms > tape->replay_clock) {
+        return SDL_FALSE;  // due in a later frame
+    }
+    *e = tape->pending;
+    tape->have_pending = SDL_FALSE;
+    return SDL_TRUE;
+}
+
+static void add_frame_timing(const Uint64 events_ticks, const Uint64 draw_ticks) {
+    if (n_frame_timings == max_frame_timings) {
+        const int new_max = max_frame_timings ? (max_frame_timings * 2) : 4096;
+        FrameTiming* ptr = (FrameTiming*)SDL_realloc(frame_timings, new_max * sizeof(FrameTiming));
+        if (!ptr) {
+            return;  // just stop collecting
+        }
+        frame_timings = ptr;
+        max_frame_timings = new_max;
+    }
+    frame_timings[n_frame_timings].events_ticks = events_ticks;
+    frame_timings[n_frame_timings].draw_ticks = draw_ticks;
+    n_frame_timings++;
+}
+
+static int SDLCALL compare_ticks(const void* a, const void* b) {
+    const Uint64 ta = *(const Uint64*)a;
+    const Uint64 tb = *(const Uint64*)b;
+    return (ta < tb) ? -1 : ((ta > tb) ? 1 : 0);
+}
+
+// sorts ticks in place
+static void log_tick_percentiles(const char* what, Uint64* ticks, const int n) {
+    static const int percentiles[] = {50, 90, 95, 99};
+    char line[256];
+    int len;
+
+    SDL_qsort(ticks, n, sizeof(Uint64), compare_ticks);
+    len = SDL_snprintf(line, sizeof(line), "%s over %d frames:", what, n);
+    for (int i = 0; i < (int)SDL_arraysize(percentiles) && len < (int)sizeof(line); i++) {
+        const int idx = (int)(((Sint64)(n - 1) * percentiles[i] + 50) / 100);
+        len += SDL_snprintf(line + len, sizeof(line) - len, " p%d %.3fms", percentiles[i],
+                            (double)ticks[idx] * 1000.0 / perf_freq);
+    }
+    if (len < (int)sizeof(line)) {
+        SDL_snprintf(line + len, sizeof(line) - len, " max %.3fms", (double)ticks[n - 1] * 1000.0 / perf_freq);
+    }
+    SDL_Log("%s", line);
+}
+
+static void log_frame_timings(void) {
+    if (n_frame_timings == 0) {
+        return;
+    }
+    Uint64* ticks = (Uint64*)SDL_malloc(n_frame_timings * sizeof(Uint64));
+    if (ticks) {
+        for (int i = 0; i < n_frame_timings; i++) {
+            ticks[i] = frame_timings[i].events_ticks;
+        }
+        log_tick_percentiles("handle_events", ticks, n_frame_timings);
+        for (int i = 0; i < n_frame_timings; i++) {
+            ticks[i] = frame_timings[i].draw_ticks;
+        }
+        log_tick_percentiles("draw_frame", ticks, n_frame_timings);
+        SDL_free(ticks);
+    }
 }
 
 static void init_everything(int argc, char** argv) {
+    // replays don't need a display or a sound card, unless SDL_VIDEODRIVER/SDL_AUDIODRIVER say otherwise
+    const SDL_bool replaying = SDL_getenv("SDLAMP_REPLAY") ? SDL_TRUE : SDL_FALSE;
+    if (replaying) {
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 0);
+        SDL_setenv("SDL_AUDIODRIVER", "dummy", 0);
+    }
+
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) == -1) {
         panic_and_abort("SDL_Init failed", SDL_GetError());
     }
@@ -570,8 +2101,25 @@ static void init_everything(int argc, char** argv) {
     // we're done with it
     SDL_EventState(SDL_DROPFILE, SDL_ENABLE);
 
-    window = SDL_CreateWindow(
-            "Hello SDL", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 275, 116, SDL_WINDOW_BORDERLESS);
+    // shaped so region.txt can cut the corners off. sdl parks shaped windows offscreen until they get their first
+    // shape, which load_skin sets, and then moves them to the position asked for here. that move ignores
+    // SDL_WINDOWPOS_UNDEFINED, so ask for centered. not every video driver can do shaped windows, those just get the
+    // plain rectangle
+    // SDLAMP_SCALE=2 (or 3, or 1.5...) makes the window bigger, the skin itself is always drawn at 1x
+    const char* scale_hint = SDL_getenv("SDLAMP_SCALE");
+    if (scale_hint) {
+        ui_scale = SDL_clamp((float)SDL_atof(scale_hint), 1.0f, 8.0f);
+    }
+    const int window_w = scale_to_window(SKIN_W);
+    const int window_h = scale_to_window(SKIN_H);
+    const Uint32 window_flags = SDL_WINDOW_BORDERLESS | SDL_WINDOW_ALLOW_HIGHDPI;
+    window = SDL_CreateShapedWindow(
+            "Hello SDL", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, window_w, window_h, window_flags);
+    if (!window) {
+        SDL_Log("SDL_CreateShapedWindow failed (%s), using a rectangular window", SDL_GetError());
+        window = SDL_CreateWindow(
+                "Hello SDL", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, window_w, window_h, window_flags);
+    }
     if (!window) {
         panic_and_abort("SDL_CreateWindow failed", SDL_GetError());
     }
@@ -579,12 +2127,25 @@ static void init_everything(int argc, char** argv) {
 
     // renderer overlays things on created window - create opengl context?
     // talk to the render in simple primitives
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_PRESENTVSYNC);
+    // no vsync for replays, frames should take as long as they take
+    const Uint32 renderer_flags = replaying ? SDL_RENDERER_TARGETTEXTURE
+                                            : (SDL_RENDERER_PRESENTVSYNC | SDL_RENDERER_TARGETTEXTURE);
+    renderer = SDL_CreateRenderer(window, -1, renderer_flags);
     if (!renderer) {
         panic_and_abort("SDL_CreateRenderer failed", SDL_GetError());
     }
+
+    // nearest so that scaling the canvas up keeps the skin's pixels crisp
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
+    canvas = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, SKIN_W, SKIN_H);
+    if (!canvas) {
+        panic_and_abort("SDL_CreateTexture failed", SDL_GetError());
+    }
     load_skin(&skin, "skinner_atlas.wsz");
 
+    perf_freq = SDL_GetPerformanceFrequency();
+    open_input_tape(&input_tape);
+
     SDL_zero(desired);
     desired.freq = 48000;
     desired.format = AUDIO_F32;
@@ -592,29 +2153,102 @@ static void init_everything(int argc, char** argv) {
     desired.samples = 4096;
     desired.callback = feed_audio_device_callback;
 
-    // 2nd null arg is for obtained audiospec param, telling sdl that if hardware has issues with desired spec, make SDL
-    // "fake" desired spec so that we can write code for desired spec (HAS to work with desired spec)
-    audio_device = SDL_OpenAudioDevice(NULL, 0, &desired, NULL, 0);
-    if (audio_device == 0) {
-        panic_and_abort("Couldn't open audio device", SDL_GetError());
+    // SDLAMP_OUTPUT_FORMAT=s16|s24 asks for an integer device format, which we limit and dither ourselves instead of
+    // leaving it to SDL's converter. devices that only do integer formats end up here too
+    const char* format_hint = SDL_getenv("SDLAMP_OUTPUT_FORMAT");
+    if (format_hint && SDL_strcasecmp(format_hint, "s16") == 0) {
+        desired.format = AUDIO_S16SYS;
+    } else if (format_hint && SDL_strcasecmp(format_hint, "s24") == 0) {
+        desired.format = AUDIO_S32SYS;
     }
 
+    // decoding always happens in F32, whatever the devices run at
     SDL_zero(audio_device_spec);
     audio_device_spec.rate = desired.freq;
-    audio_device_spec.format = desired.format;
+    audio_device_spec.format = AUDIO_F32;
     audio_device_spec.channels = desired.channels;
 
-    open_new_audio_file("music.wav");
+    decode_wakeup = SDL_CreateSemaphore(0);
+    if (!decode_wakeup) {
+        panic_and_abort("SDL_CreateSemaphore failed", SDL_GetError());
+    }
+
+    // every file argument is a player. players mix onto the default device unless a "-o <device name>" (or
+    // "--device <device name>") comes before them, which routes every file after it to that device (players naming the
+    // same device share it). with no files there's one player on music.wav
+    const char* device_name = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (SDL_strcmp(argv[i], "-o") == 0 || SDL_strcmp(argv[i], "--device") == 0) {
+            if (i + 1 == argc) {
+                panic_and_abort("Bad command line", "-o/--device needs an audio device name");
+            }
+            device_name = argv[++i];
+        } else if (n_players == MAX_PLAYERS) {
+            SDL_Log("Only %d players are supported, not playing '%s'", MAX_PLAYERS, argv[i]);
+        } else {
+            open_new_audio_file(create_player(get_output(device_name)), argv[i]);
+        }
+    }
+    if (n_players == 0) {
+        open_new_audio_file(create_player(get_output(device_name)), "music.wav");
+    }
+
+    ui_player = players[0];
+    show_player_on_skin(&skin, ui_player);
+
+    n_decode_workers = SDL_clamp(SDL_GetCPUCount() - 1, 1, SDL_min(n_players, MAX_DECODE_WORKERS));
+    for (int i = 0; i < n_decode_workers; i++) {
+        decode_workers[i] = SDL_CreateThread(decode_worker, "decode", NULL);
+        if (!decode_workers[i]) {
+            panic_and_abort("SDL_CreateThread failed", SDL_GetError());
+        }
+    }
+
+    // players start out paused, the devices themselves just run
+    for (int i = 0; i < n_outputs; i++) {
+        SDL_PauseAudioDevice(outputs[i]->device, 0);
+    }
 }
 
 static void deinit_everything() {
-    SDL_CloseAudioDevice(audio_device);
-    if (cur_sample) {
-        Sound_FreeSample(cur_sample);
-        cur_sample = NULL;
+    SDL_AtomicSet(&decode_quit, 1);
+    for (int i = 0; i < n_decode_workers; i++) {
+        SDL_SemPost(decode_wakeup);
+    }
+    for (int i = 0; i < n_decode_workers; i++) {
+        SDL_WaitThread(decode_workers[i], NULL);
+    }
+
+    for (int i = 0; i < n_outputs; i++) {
+        SDL_CloseAudioDevice(outputs[i]->device);
     }
+    for (int i = 0; i < n_players; i++) {
+        char owner[32];
+        SDL_snprintf(owner, sizeof(owner), "player %d", i);
+        dsp_log_timings(&players[i]->chain, owner);
+        free_player(players[i]);
+    }
+    for (int i = 0; i < n_outputs; i++) {
+        char owner[32];
+        SDL_snprintf(owner, sizeof(owner), "output %d", i);
+        dsp_log_timings(&outputs[i]->chain, owner);
+        dsp_free_chains(&outputs[i]->chain);
+        SDL_free(outputs[i]->mix_buf);
+        SDL_free(outputs[i]->player_buf);
+        SDL_free(outputs[i]);
+    }
+    n_players = n_outputs = 0;
+    ui_player = NULL;
+    SDL_DestroySemaphore(decode_wakeup);
+
+    close_input_tape(&input_tape);
+    log_frame_timings();
+    SDL_free(frame_timings);
+    frame_timings = NULL;
+    n_frame_timings = max_frame_timings = 0;
 
     free_skin(&skin);
+    SDL_DestroyTexture(canvas);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     PHYSFS_deinit();
@@ -664,20 +2298,65 @@ static void draw_slider(SDL_Renderer* renderer, WinampSkinSlider* slider) {
         SDL_RenderCopy(renderer, slider->tex, &slider->knob.src_unpressed_rect, &slider->knob.dest_rect);
     }
 }
-static void draw_frame(SDL_Renderer* renderer, WinampSkin* skin) {
+static WinampSkinWidgetLook widget_look(const WinampSkinWidget* widget) {
+    WinampSkinWidgetLook look;
+    SDL_zero(look);
+    look.pressed = (skin.pressed_btn == widget->btn) ? SDL_TRUE : SDL_FALSE;
+    if (widget->slider) {
+        look.val = widget->slider->val;
+        look.knob_x = widget->slider->knob.dest_rect.x;
+        look.knob_src_x = widget->slider->knob.src_unpressed_rect.x;
+    }
+    return look;
+}
+
+static SDL_bool same_look(const WinampSkinWidgetLook* a, const WinampSkinWidgetLook* b) {
+    return (a->pressed == b->pressed && a->val == b->val && a->knob_x == b->knob_x && a->knob_src_x == b->knob_src_x)
+                   ? SDL_TRUE
+                   : SDL_FALSE;
+}
 
+// draws the background and every widget touching area (NULL is the whole skin) into the current render target
+static void draw_skin_area(SDL_Renderer* renderer, WinampSkin* skin, const SDL_Rect* area, const int tbar_y) {
+    const WinampSkinMode mode = cur_skin_mode();
+    SDL_RenderSetClipRect(renderer, area);
+
+    // RenderClear ignores the clip rect, so fill instead
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderClear(renderer);
+    SDL_RenderFillRect(renderer, area);
 
-    SDL_Rect main_dest_rect = {0, 0, 275, 116};
+    SDL_Rect main_dest_rect = {0, 0, SKIN_W, SKIN_H};
     SDL_RenderCopy(renderer, skin->tex_main, NULL, &main_dest_rect);
 
-    SDL_Rect tbar_src_rect;
-    tbar_src_rect.x = 27;
+    SDL_Rect tbar_src_rect = {27, tbar_y, SKIN_W, SKIN_WINSHADE_H};
+    SDL_Rect tbar_dest_rect = {0, 0, SKIN_W, SKIN_WINSHADE_H};
+    SDL_RenderCopy(renderer, skin->tex_titlebar, &tbar_src_rect, &tbar_dest_rect);
+
+    for (int id = WIDGET_NONE + 1; id < WIDGET_MAX; id++) {
+        const WinampSkinWidget* widget = &skin->widgets[mode][id];
+        if (widget->slider) {
+            if (area == NULL || SDL_HasIntersection(area, &widget->slider->dest_rect)) {
+                draw_slider(renderer, widget->slider);
+            }
+        } else if (widget->btn) {
+            if (area == NULL || SDL_HasIntersection(area, &widget->btn->dest_rect)) {
+                draw_button(renderer, widget->btn);
+            }
+        }
+    }
+    SDL_RenderSetClipRect(renderer, NULL);
+}
+
+// the skin is composited at 1x into the canvas, and only widgets that changed since the last frame get redrawn there.
+// the window then gets one nearest-neighbor copy of the canvas, so drawing costs the same at any ui_scale
+static void draw_frame(SDL_Renderer* renderer, WinampSkin* skin) {
+    const WinampSkinMode mode = cur_skin_mode();
+    const SDL_bool focused = (SDL_GetWindowFlags(window) & SDL_WINDOW_INPUT_FOCUS) ? SDL_TRUE : SDL_FALSE;
+    int tbar_y;
     if (!winshade_mode) {
-        tbar_src_rect.y = (SDL_GetWindowFlags(window) & SDL_WINDOW_INPUT_FOCUS) ? 0 : 15;
+        tbar_y = focused ? 0 : 15;
     } else {
-        tbar_src_rect.y = (SDL_GetWindowFlags(window) & SDL_WINDOW_INPUT_FOCUS) ? 29 : 42;
+        tbar_y = focused ? 29 : 42;
 
         // handling which bitmap to use for winamp mode slider knob
         const int winshade_slider_pixelpos = (int)(skin->winshade_slider.val * (skin->winshade_slider.frame_width - 1));
@@ -692,27 +2371,35 @@ static void draw_frame(SDL_Renderer* renderer, WinampSkin* skin) {
             skin->winshade_slider.knob.src_pressed_rect.x = 23;
         } 
     }
-    tbar_src_rect.w = 275;
-    tbar_src_rect.h = 14;
-
-    SDL_Rect tbar_dest_rect = {0, 0, 275, 14};
-    SDL_RenderCopy(renderer, skin->tex_titlebar, &tbar_src_rect, &tbar_dest_rect);
 
-    if (winshade_mode) {
-        for (int i = 0; i < (int)SDL_arraysize(skin->winshade_buttons); i++) {
-            draw_button(renderer, &skin->winshade_buttons[i]);
+    SDL_SetRenderTarget(renderer, canvas);
+    if (!skin->canvas_valid || skin->drawn_mode != mode || skin->drawn_tbar_y != tbar_y) {
+        draw_skin_area(renderer, skin, NULL, tbar_y);
+        for (int id = WIDGET_NONE + 1; id < WIDGET_MAX; id++) {
+            skin->widgets[mode][id].drawn = widget_look(&skin->widgets[mode][id]);
         }
-        draw_slider(renderer, &skin->winshade_slider);
-
+        skin->canvas_valid = SDL_TRUE;
+        skin->drawn_mode = mode;
+        skin->drawn_tbar_y = tbar_y;
     } else {
-        for (int i = 0; i < (int)SDL_arraysize(skin->buttons); i++) {
-            draw_button(renderer, &skin->buttons[i]);
-        }
-        for (int i = 0; i < (int)SDL_arraysize(skin->sliders); i++) {
-            draw_slider(renderer, &skin->sliders[i]);
+        for (int id = WIDGET_NONE + 1; id < WIDGET_MAX; id++) {
+            WinampSkinWidget* widget = &skin->widgets[mode][id];
+            if (widget->btn == NULL) {
+                continue;
+            }
+            const WinampSkinWidgetLook look = widget_look(widget);
+            if (!same_look(&look, &widget->drawn)) {
+                const SDL_Rect* dirty_rect = widget->slider ? &widget->slider->dest_rect : &widget->btn->dest_rect;
+                draw_skin_area(renderer, skin, dirty_rect, tbar_y);
+                widget->drawn = look;
+            }
         }
     }
+    SDL_SetRenderTarget(renderer, NULL);
 
+    // whole output, not the window size, so highdpi displays get every pixel
+    const SDL_Rect canvas_src_rect = {0, 0, SKIN_W, winshade_mode ? SKIN_WINSHADE_H : SKIN_H};
+    SDL_RenderCopy(renderer, canvas, &canvas_src_rect, NULL);
     SDL_RenderPresent(renderer);
 }
 
@@ -729,56 +2416,40 @@ static void handle_slider_motion(WinampSkinSlider* slider, const SDL_Point* pt)
         const int max_knob_x = slider->dest_rect.x + slider->dest_rect.w
                                - slider->knob.dest_rect.w;  // want to pre-calc this before feeding into macro
         slider->knob.dest_rect.x = SDL_clamp(new_knob_x, min_knob_x, max_knob_x);
-        SDL_LockAudioDevice(audio_device);
         slider->val = SDL_clamp(new_val, 0.0f, 1.0f);
-        SDL_UnlockAudioDevice(audio_device);
+        publish_audio_params(&skin);
     }
 }
 
 static SDL_bool handle_events(WinampSkin* skin) {
     SDL_Event e;
-    while (SDL_PollEvent(&e)) {
+    begin_input_frame(&input_tape);
+    while (poll_input_event(&input_tape, &e)) {
         switch (e.type) {
             case SDL_QUIT: {
                 return SDL_FALSE;
                 break;
             }
 
+            // the canvas' contents are gone when the gpu device/targets get reset, redraw all of it next frame
+            case SDL_RENDER_TARGETS_RESET:
+            case SDL_RENDER_DEVICE_RESET: {
+                skin->canvas_valid = SDL_FALSE;
+                break;
+            }
+
             case SDL_MOUSEBUTTONDOWN: {
                 // we only care about left clicking
                 if (e.button.button != SDL_BUTTON_LEFT) {
                     break;
                 }
 
-                const SDL_Point pt = {e.button.x, e.button.y};
+                const SDL_Point pt = window_to_skin(e.button.x, e.button.y);
                 if (skin->pressed_btn == NULL) {
-                    if (winshade_mode) {
-                        for (int i = 0; i < (int)SDL_arraysize(skin->winshade_buttons); i++) {
-                            WinampSkinBtn* btn = &skin->winshade_buttons[i];
-                            if (SDL_PointInRect(&pt, &btn->dest_rect)) {
-                                skin->pressed_btn = btn;
-                                break;
-                            }
-                        }
-                        if (SDL_PointInRect(&pt, &skin->winshade_slider.dest_rect)) {
-                            skin->pressed_btn = &skin->winshade_slider.knob;
-                            break;
-                        }
-                    } else {
-                        for (int i = 0; i < (int)SDL_arraysize(skin->buttons); i++) {
-                            WinampSkinBtn* btn = &skin->buttons[i];
-                            if (SDL_PointInRect(&pt, &btn->dest_rect)) {
-                                skin->pressed_btn = btn;
-                                break;
-                            }
-                        }
-                        for (int i = 0; i < (int)SDL_arraysize(skin->sliders); i++) {
-                            WinampSkinSlider* slider = &skin->sliders[i];
-                            if (SDL_PointInRect(&pt, &slider->dest_rect)) {
-                                skin->pressed_btn = &slider->knob;
-                                break;
-                            }
-                        }
+                    const Uint8 id = skin_hittest(skin, &pt);
+                    if (id != WIDGET_NONE) {
+                        skin->pressed_btn = skin->widgets[cur_skin_mode()][id].btn;
+                        skin->pressed_widget = id;
                     }
                 }
 
@@ -800,28 +2471,51 @@ static SDL_bool handle_events(WinampSkin* skin) {
                     SDL_CaptureMouse(SDL_FALSE);
                     if (skin->pressed_btn->clickfn) {
 
-                        // only call button's clickfn if mouse is released while inside button's rect
-                        const SDL_Point pt = {e.button.x, e.button.y};
-                        if (SDL_PointInRect(&pt, &skin->pressed_btn->dest_rect)) {
+                        // only call button's clickfn if mouse is released while over the same button
+                        const SDL_Point pt = window_to_skin(e.button.x, e.button.y);
+                        if (skin_hittest(skin, &pt) == skin->pressed_widget) {
                             skin->pressed_btn->clickfn();
                         }
                     }
                     skin->pressed_btn = NULL;
+                    skin->pressed_widget = WIDGET_NONE;
                 }
                 break;
             }
 
             case SDL_MOUSEMOTION: {
-                const SDL_Point pt = {e.motion.x, e.motion.y};
-                if (winshade_mode) {
-                    handle_slider_motion(&skin->winshade_slider, &pt);
-                    break;
-                } else {
-                    for (int i = 0; i < (int)SDL_arraysize(skin->sliders); i++) {
-                        handle_slider_motion(&skin->sliders[i], &pt);
+                // only the pressed slider (if any) can move
+                WinampSkinSlider* slider = skin->widgets[cur_skin_mode()][skin->pressed_widget].slider;
+                if (slider) {
+                    const SDL_Point pt = window_to_skin(e.motion.x, e.motion.y);
+                    handle_slider_motion(slider, &pt);
+                }
+                break;
+            }
+
+            // [ and ] change playback speed in 0.1x steps, - and = shift pitch by a semitone, backspace resets both.
+            // tab switches which player the skin controls
+            case SDL_KEYDOWN: {
+                switch (e.key.keysym.sym) {
+                    case SDLK_LEFTBRACKET: set_speed(ui_player, atomic_get_float(&ui_player->speed_target) - 0.1f); break;
+                    case SDLK_RIGHTBRACKET: set_speed(ui_player, atomic_get_float(&ui_player->speed_target) + 0.1f); break;
+                    case SDLK_MINUS: set_pitch_semitones(ui_player, ui_player->pitch_semitones - 1); break;
+                    case SDLK_EQUALS: set_pitch_semitones(ui_player, ui_player->pitch_semitones + 1); break;
+                    case SDLK_BACKSPACE:
+                        set_speed(ui_player, 1.0f);
+                        set_pitch_semitones(ui_player, 0);
+                        break;
+                    case SDLK_TAB: {
+                        int idx = 0;
+                        while (players[idx] != ui_player) {
+                            idx++;
+                        }
+                        ui_player = players[(idx + 1) % n_players];
+                        show_player_on_skin(skin, ui_player);
+                        break;
                     }
-                    break;
                 }
+                break;
             }
 
             case SDL_DROPFILE: {
@@ -829,7 +2523,7 @@ static SDL_bool handle_events(WinampSkin* skin) {
                 if ((ptr && SDL_strcasecmp(ptr, ".wsz") == 0) || (SDL_strcasecmp(ptr, ".zip") == 0)) {
                     load_skin(skin, e.drop.file);
                 } else {
-                    open_new_audio_file(e.drop.file);
+                    open_new_audio_file(ui_player, e.drop.file);
                 }
                 SDL_free(e.drop.file);
                 break;
@@ -841,8 +2535,17 @@ static SDL_bool handle_events(WinampSkin* skin) {
 
 int main(int argc, char** argv) {
     init_everything(argc, argv);  // will panic and abort on fail
-    while (handle_events(&skin)) {
+    const SDL_bool time_frames = input_tape.replay ? SDL_TRUE : SDL_FALSE;
+    for (;;) {
+        const Uint64 events_start = SDL_GetPerformanceCounter();
+        if (!handle_events(&skin)) {
+            break;
+        }
+        const Uint64 draw_start = SDL_GetPerformanceCounter();
         draw_frame(renderer, &skin);
+        if (time_frames) {
+            add_frame_timing(draw_start - events_start, SDL_GetPerformanceCounter() - draw_start);
+        }
     }
 
     deinit_everything();